@@ -0,0 +1,446 @@
+// kvkbd-bench: timings of the keyboard pipeline hot paths
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "keysymconvert.h"
+#include "keysymtab.h"
+#include "mainwidget.h"
+#include "startuploader.h"
+#include "themeloader.h"
+#include "x11connection.h"
+#include "x11keyboard.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPixmap>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+
+#include <algorithm>
+#include <functional>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+struct Result {
+    QString name;
+    //operations per sample
+    int batch;
+    //ns per sample, sorted
+    QVector<qint64> samples;
+    qint64 totalNs;
+    //heap held by what was benchmarked, -1 if not measured
+    qint64 heapBytes = -1;
+};
+
+static bool verbose = false;
+
+static void messageFilter(QtMsgType type, const QMessageLogContext&, const QString& msg)
+{
+    if (type == QtDebugMsg && !verbose) return;
+    QTextStream(stderr) << msg << "\n";
+}
+
+//ns per operation at @p percent of the sorted samples
+static double percentile(const Result& result, double percent)
+{
+    if (result.samples.isEmpty()) return 0;
+    int index = qBound(0, (int)(percent / 100.0 * result.samples.size()), result.samples.size() - 1);
+    return (double)result.samples.at(index) / result.batch;
+}
+
+static double throughput(const Result& result)
+{
+    if (result.totalNs <= 0) return 0;
+    return (double)result.samples.size() * result.batch * 1e9 / result.totalNs;
+}
+
+/**
+ * Runs @p op @p samples times after a few warm up runs. @p op performs
+ * @p batch operations, which keeps the timer out of the cheap ones.
+ */
+static Result measure(const QString& name, int samples, int batch, const std::function<void(int)>& op)
+{
+    Result result;
+    result.name = name;
+    result.batch = batch;
+    result.samples.reserve(samples);
+
+    for (int a=0; a<qMin(samples, 8); a++) {
+        op(a);
+    }
+
+    QElapsedTimer timer;
+    QElapsedTimer total;
+    total.start();
+    for (int a=0; a<samples; a++) {
+        timer.start();
+        op(a);
+        result.samples.append(timer.nsecsElapsed());
+    }
+    result.totalNs = total.nsecsElapsed();
+
+    std::sort(result.samples.begin(), result.samples.end());
+    return result;
+}
+
+static void report(const Result& result)
+{
+    QTextStream out(stdout);
+    out << result.name.leftJustified(20)
+        << QString::fromLatin1("%1 op/s  p50 %2 us  p90 %3 us  p99 %4 us  max %5 us\n")
+               .arg(throughput(result), 0, 'f', 0)
+               .arg(percentile(result, 50) / 1000.0, 0, 'f', 3)
+               .arg(percentile(result, 90) / 1000.0, 0, 'f', 3)
+               .arg(percentile(result, 99) / 1000.0, 0, 'f', 3)
+               .arg(percentile(result, 100) / 1000.0, 0, 'f', 3);
+    if (result.heapBytes >= 0) {
+        out << QString(20, QLatin1Char(' ')) << "heap " << result.heapBytes / 1024 << " KiB\n";
+    }
+}
+
+static QJsonObject toJson(const Result& result)
+{
+    QJsonObject object;
+    object.insert(QLatin1String("name"), result.name);
+    object.insert(QLatin1String("samples"), result.samples.size());
+    object.insert(QLatin1String("batch"), result.batch);
+    object.insert(QLatin1String("opsPerSecond"), throughput(result));
+    object.insert(QLatin1String("p50Ns"), percentile(result, 50));
+    object.insert(QLatin1String("p90Ns"), percentile(result, 90));
+    object.insert(QLatin1String("p99Ns"), percentile(result, 99));
+    object.insert(QLatin1String("maxNs"), percentile(result, 100));
+    if (result.heapBytes >= 0) {
+        object.insert(QLatin1String("heapBytes"), result.heapBytes);
+    }
+    return object;
+}
+
+//bytes allocated on the heap and not freed, -1 if unknown
+static qint64 heapInUse()
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks;
+#else
+    return (unsigned int)mallinfo().uordblks;
+#endif
+#else
+    return -1;
+#endif
+}
+
+//KeySymConvert::convert as it was before the page tables
+static long convertBySearch(KeySym keysym)
+{
+    if ((keysym >= 0x0020 && keysym <= 0x007e) ||
+            (keysym >= 0x00a0 && keysym <= 0x00ff))
+        return keysym;
+
+    if (isSpecialKeysym(keysym))
+        return keysym & 0x7f;
+
+    if (keysym >= 0x0100d800 && keysym <= 0x0100dfff)
+        return NO_KEYSYM_UNICODE_CONVERSION;
+
+    if (0x01000000 <= keysym && keysym <= 0x0110ffff)
+        return keysym - 0x01000000;
+
+    return searchKeysymtab(keysym);
+}
+
+/**
+ * Compares convert() with the binary search for every 16 bit keysym and
+ * a stride of the directly encoded ones, and checks that fromUcs() maps
+ * each character of keysymtab back to a keysym producing it.
+ *
+ * @return the number of mismatches
+ */
+static int checkKeysymConvert(const KeySymConvert& convert)
+{
+    QTextStream err(stderr);
+    int mismatches = 0;
+
+    auto check = [&](KeySym keysym) {
+        if (convert.convert(keysym) != convertBySearch(keysym)) {
+            if (mismatches++ < 10) {
+                err << "kvkbd-bench: convert(0x" << QString::number(keysym, 16) << ") differs from the search\n";
+            }
+        }
+    };
+    for (KeySym keysym = 0; keysym <= 0xffff; keysym++) {
+        check(keysym);
+    }
+    for (KeySym keysym = 0x01000000; keysym <= 0x0110ffff; keysym += 0x101) {
+        check(keysym);
+    }
+
+    for (const codepair &pair : keysymtab) {
+        if (convert.convert(convert.fromUcs(pair.ucs)) != pair.ucs) {
+            if (mismatches++ < 10) {
+                err << "kvkbd-bench: fromUcs(0x" << QString::number(pair.ucs, 16) << ") does not convert back\n";
+            }
+        }
+    }
+    return mismatches;
+}
+
+//the first part loaded, the main keyboard
+static MainWidget *loadTheme(QWidget *parent, ThemeLoader *loader)
+{
+    MainWidget *first = nullptr;
+    QObject::connect(loader, &ThemeLoader::partLoaded, parent, [&first](MainWidget *part, int, int) {
+        if (!first) first = part;
+    });
+    loader->loadLayout(QLatin1String("standard"), QLatin1String(":/themes/"));
+    QObject::disconnect(loader, &ThemeLoader::partLoaded, parent, nullptr);
+    return first;
+}
+
+int main(int argc, char **argv)
+{
+    // Xvfb provides the X server for XTest, Qt itself paints offscreen
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    qInstallMessageHandler(messageFilter);
+
+    QApplication app(argc, argv);
+    QApplication::setApplicationName(QLatin1String("kvkbd-bench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("Times the kvkbd keyboard pipeline. Run it on a scratch X server such as Xvfb, "
+                                                   "key injection sends real key events to the display."));
+    parser.addHelpOption();
+    QCommandLineOption samplesOption(QLatin1String("samples"), QLatin1String("Samples per benchmark, 1000 by default."), QLatin1String("count"));
+    parser.addOption(samplesOption);
+    QCommandLineOption jsonOption(QLatin1String("json"), QLatin1String("Also write the results to <file>."), QLatin1String("file"));
+    parser.addOption(jsonOption);
+    QCommandLineOption labelOption(QLatin1String("label"), QLatin1String("Recorded in the JSON output, e.g. a commit id."), QLatin1String("label"));
+    parser.addOption(labelOption);
+    QCommandLineOption verboseOption(QLatin1String("verbose"), QLatin1String("Show the debug output of kvkbd."));
+    parser.addOption(verboseOption);
+    parser.process(app);
+
+    verbose = parser.isSet(verboseOption);
+    int samples = parser.isSet(samplesOption) ? qMax(10, parser.value(samplesOption).toInt()) : 1000;
+
+    QList<Result> results;
+    //XOpenDisplay calls before and after the key injection runs, -1 if not run
+    qint64 openedBefore = -1;
+    qint64 openedAfter = -1;
+
+    KeySymConvert convert;
+    int mismatches = checkKeysymConvert(convert);
+    if (mismatches > 0) {
+        QTextStream(stderr) << "kvkbd-bench: " << mismatches << " keysym conversion mismatches\n";
+        return 1;
+    }
+
+    // Every keysym of keysymtab, page tables against the old search
+    QVector<KeySym> keySyms;
+    for (const codepair &pair : keysymtab) {
+        keySyms << pair.keysym;
+    }
+    results << measure(QLatin1String("keysymConvert"), samples, keySyms.size(), [&convert, &keySyms](int) {
+        volatile long sum = 0;
+        for (KeySym sym : std::as_const(keySyms)) {
+            sum += convert.convert(sym);
+        }
+    });
+    results << measure(QLatin1String("keysymSearch"), samples, keySyms.size(), [&keySyms](int) {
+        volatile long sum = 0;
+        for (KeySym sym : std::as_const(keySyms)) {
+            sum += convertBySearch(sym);
+        }
+    });
+
+    QWidget window;
+    window.resize(1000, 300);
+    window.show();
+
+    ThemeLoader *loader = new ThemeLoader(&window);
+    results << measure(QLatin1String("themeLoad"), qMax(10, samples / 20), 1, [&window, loader](int) {
+        loadTheme(&window, loader);
+        qDeleteAll(window.findChildren<MainWidget*>(QString(), Qt::FindDirectChildrenOnly));
+    });
+    MainWidget *part = loadTheme(&window, loader);
+    if (!part) {
+        QTextStream(stderr) << "kvkbd-bench: unable to load the standard theme\n";
+        return 1;
+    }
+    part->show();
+
+    QStringList colors;
+    const QFileInfoList colorFiles = QDir(QLatin1String(":/colors"), QLatin1String("*.css")).entryInfoList();
+    for (const QFileInfo &info : colorFiles) {
+        colors << info.absoluteFilePath();
+    }
+    if (!colors.isEmpty()) {
+        results << measure(QLatin1String("colorSwitch"), qMax(10, samples / 10), 1, [loader, &colors](int a) {
+            loader->loadColorFile(colors.at(a % colors.size()));
+        });
+    }
+
+    // The standard theme as one VButton widget per key and as a single
+    // KeyboardSurface: heap held once painted and the time of a full repaint
+    for (bool painted : {false, true}) {
+        QWidget keyboard;
+        keyboard.resize(1000, 300);
+        ThemeLoader *modeLoader = new ThemeLoader(&keyboard);
+        modeLoader->setPaintedKeys(painted);
+
+        qint64 before = heapInUse();
+        if (!loadTheme(&keyboard, modeLoader)) continue;
+        keyboard.show();
+
+        QPixmap target(keyboard.size());
+        keyboard.render(&target);
+        qint64 held = before >= 0 ? heapInUse() - before : -1;
+
+        Result result = measure(QLatin1String(painted ? "paintSurface" : "paintButtons"), qMax(10, samples / 10), 1, [&keyboard, &target](int) {
+            keyboard.render(&target);
+        });
+        result.heapBytes = held;
+        results << result;
+    }
+
+    // A new size every step, as a drag resize visits
+    results << measure(QLatin1String("resize"), samples, 1, [part](int a) {
+        part->resize(600 + (a % 48) * 10, 180 + (a % 48) * 3);
+    });
+
+    Display *display = X11Connection::display();
+    if (!display) {
+        QTextStream(stderr) << "kvkbd-bench: no X server, skipping the keyboard benchmarks\n";
+    }
+    else {
+        // The blocking part of startup: keyboard setup, theme and colors,
+        // one after the other and with StartupLoader as initGui runs them
+        QString colorFile = ThemeLoader::selectedColorFile(QString());
+        results << measure(QLatin1String("startupSerial"), qMax(10, samples / 50), 1, [&colorFile](int) {
+            X11Keyboard keyboard;
+            ThemeData theme;
+            ThemeLoader::readTheme(QLatin1String("standard"), QLatin1String(":/themes/"), theme, nullptr);
+            ColorStyle style;
+            style.load(colorFile);
+        });
+
+        results << measure(QLatin1String("startupParallel"), qMax(10, samples / 50), 1, [&colorFile](int) {
+            StartupLoader startup;
+            startup.loadTheme(QLatin1String("standard"), QLatin1String(":/themes/"));
+            startup.loadColorStyle(colorFile, QGuiApplication::palette());
+            X11Keyboard keyboard;
+            startup.waitForDone();
+        });
+
+        X11Keyboard xkbd;
+        QObject::connect(&xkbd, SIGNAL(layoutUpdated(int,QString)), part, SLOT(updateLayout(int,QString)));
+
+        results << measure(QLatin1String("textForKeyCode"), samples, 248, [&xkbd](int) {
+            ButtonText text;
+            for (unsigned int keyCode = 8; keyCode < 256; keyCode++) {
+                xkbd.textForKeyCode(keyCode, text);
+            }
+        });
+
+        results << measure(QLatin1String("layoutRelabel"), samples, 1, [&xkbd](int) {
+            xkbd.resendState();
+        });
+
+        // Shift clicks, harmless to whatever has the focus
+        unsigned int shift = XKeysymToKeycode(display, XK_Shift_L);
+        QEventLoop loop;
+        QTimer timeout;
+        timeout.setSingleShot(true);
+        QObject::connect(&xkbd, SIGNAL(keyProcessComplete(unsigned int)), &loop, SLOT(quit()));
+        QObject::connect(&timeout, SIGNAL(timeout()), &loop, SLOT(quit()));
+
+        // Every connection is opened up front, none per key
+        openedBefore = X11Connection::openCount();
+        results << measure(QLatin1String("keyInjection"), samples, 1, [&xkbd, &loop, &timeout, shift](int) {
+            xkbd.processKeyPress(shift);
+            timeout.start(1000);
+            loop.exec();
+        });
+
+        // Queued back to back, the batching of InjectionThread at work
+        results << measure(QLatin1String("keyInjectionBurst"), qMax(10, samples / 20), 64, [&xkbd, shift](int) {
+            quint64 target = xkbd.injectedEvents() + 64 * 2;
+            for (int a=0; a<64; a++) {
+                xkbd.processKeyPress(shift);
+            }
+            QElapsedTimer wait;
+            wait.start();
+            while (xkbd.injectedEvents() < target && wait.elapsed() < 1000) {
+                QThread::usleep(50);
+            }
+        });
+        openedAfter = X11Connection::openCount();
+
+        // Mostly keymap lookups with a shifted letter each word, the last
+        // characters are on no layout level and go through the scratch keys
+        const QString text = QString::fromUtf8("The quick brown fox Jumps over the lazy Dog 0123456789 \u2603\u2615");
+        int sent = 0;
+        int typed = 0;
+        QObject::disconnect(&xkbd, SIGNAL(keyProcessComplete(unsigned int)), &loop, SLOT(quit()));
+        QObject::connect(&xkbd, &VKeyboard::keyProcessComplete, &loop, [&sent, &typed, &loop]() {
+            if (++sent >= typed) {
+                loop.quit();
+            }
+        });
+
+        results << measure(QLatin1String("typeText"), qMax(10, samples / 20), text.size(), [&xkbd, &loop, &timeout, &text, &sent, &typed](int) {
+            sent = 0;
+            typed = xkbd.typeText(text);
+            if (typed > 0) {
+                timeout.start(1000);
+                loop.exec();
+            }
+        });
+    }
+
+    QJsonArray benchmarks;
+    for (const Result &result : std::as_const(results)) {
+        report(result);
+        benchmarks.append(toJson(result));
+    }
+    if (openedBefore >= 0) {
+        QTextStream(stdout) << "X11 connections opened: " << openedBefore << " before key injection, "
+                            << openedAfter << " after\n";
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QJsonObject root;
+        root.insert(QLatin1String("label"), parser.value(labelOption));
+        root.insert(QLatin1String("date"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+        root.insert(QLatin1String("qt"), QLatin1String(qVersion()));
+        root.insert(QLatin1String("benchmarks"), benchmarks);
+        if (openedBefore >= 0) {
+            root.insert(QLatin1String("connectionsBefore"), openedBefore);
+            root.insert(QLatin1String("connectionsAfter"), openedAfter);
+        }
+
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream(stderr) << "kvkbd-bench: unable to write " << file.fileName() << "\n";
+            return 1;
+        }
+        file.write(QJsonDocument(root).toJson());
+    }
+
+    return 0;
+}
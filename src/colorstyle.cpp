@@ -0,0 +1,420 @@
+// Class ColorStyle: color stylesheet compiled into a table of key styles
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "colorstyle.h"
+
+#include <QAtomicInteger>
+#include <QFile>
+#include <QGuiApplication>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QPalette>
+#include <QRegularExpression>
+#include <QStringList>
+
+#include <algorithm>
+
+const ColorStyle *ColorStyle::s_active = nullptr;
+
+static QAtomicInteger<quint64> s_serial(0);
+
+namespace {
+
+enum Field {
+    BackgroundField = 0x01,
+    BorderColorField = 0x02,
+    BorderWidthField = 0x04,
+    BorderStyleField = 0x08,
+    RadiusField = 0x10,
+    MarginField = 0x20,
+    TextField = 0x40
+};
+
+struct Rule
+{
+    QString colorGroup;
+    QString action;
+    int states = 0;
+    int specificity = 0;
+    int order = 0;
+    //Field flags of the declarations present in values
+    int fields = 0;
+    ColorStyle::KeyStyle values;
+};
+
+//splits at separator, ignoring those inside parentheses
+QStringList splitTopLevel(const QString& text, QChar separator)
+{
+    QStringList parts;
+    int depth = 0;
+    int start = 0;
+    for (int a=0; a<text.size(); a++) {
+        QChar c = text.at(a);
+        if (c == QLatin1Char('(')) depth++;
+        else if (c == QLatin1Char(')')) depth--;
+        else if (c == separator && depth == 0) {
+            parts << text.mid(start, a - start).trimmed();
+            start = a + 1;
+        }
+    }
+    parts << text.mid(start).trimmed();
+    return parts;
+}
+
+QString functionArguments(const QString& value)
+{
+    int open = value.indexOf(QLatin1Char('('));
+    int close = value.lastIndexOf(QLatin1Char(')'));
+    if (open < 0 || close < open) return QString();
+    return value.mid(open + 1, close - open - 1);
+}
+
+int parseLength(const QString& value)
+{
+    QString first = value.trimmed().section(QLatin1Char(' '), 0, 0);
+    first.remove(QLatin1String("px"));
+    return qRound(first.toDouble());
+}
+
+int parseColorComponent(const QString& value)
+{
+    QString v = value.trimmed();
+    if (v.endsWith(QLatin1Char('%'))) {
+        v.chop(1);
+        return qBound(0, qRound(v.toDouble() * 255 / 100), 255);
+    }
+    return qBound(0, v.toInt(), 255);
+}
+
+QColor parseColor(const QString& value)
+{
+    QString v = value.trimmed();
+    if (v == QLatin1String("none") || v == QLatin1String("transparent")) {
+        return QColor(Qt::transparent);
+    }
+    if (v.startsWith(QLatin1String("rgb"))) {
+        QStringList args = functionArguments(v).split(QLatin1Char(','));
+        if (args.size() < 3) return QColor();
+        QColor color(parseColorComponent(args.at(0)), parseColorComponent(args.at(1)), parseColorComponent(args.at(2)));
+        if (args.size() > 3) {
+            color.setAlpha(parseColorComponent(args.at(3)));
+        }
+        return color;
+    }
+    return QColor(v);
+}
+
+QBrush parseBrush(const QString& value)
+{
+    QString v = value.trimmed();
+    if (!v.startsWith(QLatin1String("qlineargradient"))) {
+        return QBrush(parseColor(v));
+    }
+
+    qreal x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+    QGradientStops stops;
+    const QStringList args = splitTopLevel(functionArguments(v), QLatin1Char(','));
+    for (const QString &arg : args) {
+        QString name = arg.section(QLatin1Char(':'), 0, 0).trimmed();
+        QString param = arg.section(QLatin1Char(':'), 1).trimmed();
+        if (name == QLatin1String("x1")) x1 = param.toDouble();
+        else if (name == QLatin1String("y1")) y1 = param.toDouble();
+        else if (name == QLatin1String("x2")) x2 = param.toDouble();
+        else if (name == QLatin1String("y2")) y2 = param.toDouble();
+        else if (name == QLatin1String("stop")) {
+            stops << QGradientStop(param.section(QLatin1Char(' '), 0, 0).toDouble(),
+                                   parseColor(param.section(QLatin1Char(' '), 1)));
+        }
+    }
+
+    QLinearGradient gradient(x1, y1, x2, y2);
+    gradient.setCoordinateMode(QGradient::ObjectBoundingMode);
+    gradient.setStops(stops);
+    return QBrush(gradient);
+}
+
+int parseBorderStyle(const QString& value)
+{
+    if (value == QLatin1String("none")) return ColorStyle::NoBorder;
+    if (value == QLatin1String("inset")) return ColorStyle::InsetBorder;
+    if (value == QLatin1String("outset")) return ColorStyle::OutsetBorder;
+    return ColorStyle::SolidBorder;
+}
+
+void parseDeclaration(Rule& rule, const QString& name, const QString& value)
+{
+    ColorStyle::KeyStyle &style = rule.values;
+
+    if (name == QLatin1String("background-color") || name == QLatin1String("background")) {
+        style.background = parseBrush(value);
+        rule.fields |= BackgroundField;
+    }
+    else if (name == QLatin1String("border-color")) {
+        style.borderColor = parseColor(value);
+        rule.fields |= BorderColorField;
+    }
+    else if (name == QLatin1String("border-width")) {
+        style.borderWidth = parseLength(value);
+        rule.fields |= BorderWidthField;
+    }
+    else if (name == QLatin1String("border-style")) {
+        style.borderStyle = parseBorderStyle(value);
+        rule.fields |= BorderStyleField;
+    }
+    else if (name == QLatin1String("border-radius")) {
+        style.radius = parseLength(value);
+        rule.fields |= RadiusField;
+    }
+    else if (name == QLatin1String("margin")) {
+        style.margin = parseLength(value);
+        rule.fields |= MarginField;
+    }
+    else if (name == QLatin1String("color")) {
+        style.text = parseColor(value);
+        rule.fields |= TextField;
+    }
+    else if (name == QLatin1String("border")) {
+        //shorthand: none, or any of width, style and color
+        const QStringList tokens = splitTopLevel(value, QLatin1Char(' '));
+        for (const QString &token : tokens) {
+            if (token.isEmpty()) continue;
+            if (token == QLatin1String("none")) {
+                style.borderStyle = ColorStyle::NoBorder;
+                style.borderWidth = 0;
+                rule.fields |= BorderStyleField | BorderWidthField;
+            }
+            else if (token.at(0).isDigit()) {
+                style.borderWidth = parseLength(token);
+                rule.fields |= BorderWidthField;
+            }
+            else if (token == QLatin1String("solid") || token == QLatin1String("inset") || token == QLatin1String("outset")) {
+                style.borderStyle = parseBorderStyle(token);
+                rule.fields |= BorderStyleField;
+            }
+            else {
+                style.borderColor = parseColor(token);
+                rule.fields |= BorderColorField;
+            }
+        }
+    }
+}
+
+void applyRule(ColorStyle::KeyStyle& style, const Rule& rule)
+{
+    const ColorStyle::KeyStyle &values = rule.values;
+    if (rule.fields & BackgroundField) style.background = values.background;
+    if (rule.fields & BorderColorField) style.borderColor = values.borderColor;
+    if (rule.fields & BorderWidthField) style.borderWidth = values.borderWidth;
+    if (rule.fields & BorderStyleField) style.borderStyle = values.borderStyle;
+    if (rule.fields & RadiusField) style.radius = values.radius;
+    if (rule.fields & MarginField) style.margin = values.margin;
+    if (rule.fields & TextField) style.text = values.text;
+}
+
+}
+
+ColorStyle::ColorStyle() : radius(0), id(0)
+{
+    parse(QString());
+}
+
+bool ColorStyle::load(const QString& fileName)
+{
+    return load(fileName, QGuiApplication::palette());
+}
+
+bool ColorStyle::load(const QString& fileName, const QPalette& palette)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    parse(QString::fromLatin1(file.readAll()), palette);
+    return true;
+}
+
+void ColorStyle::parse(const QString& source)
+{
+    parse(source, QGuiApplication::palette());
+}
+
+void ColorStyle::parse(const QString& source, const QPalette& palette)
+{
+    static const QRegularExpression comments(QLatin1String("/\\*.*?\\*/"), QRegularExpression::DotMatchesEverythingOption);
+    static const QRegularExpression selectorPattern(QLatin1String("^(\\w+)((?:\\[[^\\]]*\\])*)((?::\\w+)*)$"));
+    static const QRegularExpression attributePattern(QLatin1String("\\[\\s*(\\w+)\\s*=\\s*\"?([^\"\\]]*)\"?\\s*\\]"));
+
+    QString css = source;
+    css.remove(comments);
+
+    QVector<Rule> rules;
+    background = QBrush(Qt::transparent);
+    radius = 0;
+
+    const QStringList blocks = css.split(QLatin1Char('}'));
+    for (const QString &block : blocks) {
+        int brace = block.indexOf(QLatin1Char('{'));
+        if (brace < 0) continue;
+
+        Rule declarations;
+        const QStringList lines = splitTopLevel(block.mid(brace + 1), QLatin1Char(';'));
+        for (const QString &line : lines) {
+            int colon = line.indexOf(QLatin1Char(':'));
+            if (colon < 0) continue;
+            parseDeclaration(declarations, line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+        }
+
+        const QStringList selectors = block.left(brace).split(QLatin1Char(','));
+        for (const QString &selector : selectors) {
+            QRegularExpressionMatch match = selectorPattern.match(selector.simplified().remove(QLatin1Char(' ')));
+            if (!match.hasMatch()) continue;
+
+            QString type = match.captured(1);
+            Rule rule = declarations;
+            rule.order = rules.size();
+            rule.specificity = 1;
+            bool supported = true;
+
+            QRegularExpressionMatchIterator attributes = attributePattern.globalMatch(match.captured(2));
+            while (attributes.hasNext()) {
+                QRegularExpressionMatch attribute = attributes.next();
+                QString attributeName = attribute.captured(1);
+                if (attributeName == QLatin1String("colorGroup")) rule.colorGroup = attribute.captured(2);
+                else if (attributeName == QLatin1String("action")) rule.action = attribute.captured(2);
+                else if (type == QLatin1String("QWidget") && attributeName == QLatin1String("name") && attribute.captured(2) == QLatin1String("main")) {
+                    if (rule.fields & BackgroundField) background = rule.values.background;
+                    if (rule.fields & RadiusField) radius = rule.values.radius;
+                    supported = false;
+                }
+                else supported = false;
+                rule.specificity += 10;
+            }
+
+            const QStringList states = match.captured(3).split(QLatin1Char(':'));
+            for (const QString &state : states) {
+                if (state.isEmpty()) continue;
+                if (state == QLatin1String("pressed")) rule.states |= Pressed;
+                else if (state == QLatin1String("checked")) rule.states |= Checked;
+                else if (state == QLatin1String("hover")) rule.states |= Hover;
+                else supported = false;
+                rule.specificity += 10;
+            }
+
+            if (supported && (type == QLatin1String("VButton") || type == QLatin1String("QPushButton"))) {
+                rules.append(rule);
+            }
+        }
+    }
+
+    std::stable_sort(rules.begin(), rules.end(), [](const Rule &a, const Rule &b) {
+        return a.specificity != b.specificity ? a.specificity < b.specificity : a.order < b.order;
+    });
+
+    //index 0 stands for values no rule selects
+    colorGroups.clear();
+    actions.clear();
+    QStringList groupNames(QString());
+    QStringList actionNames(QString());
+    for (const Rule &rule : std::as_const(rules)) {
+        if (!rule.colorGroup.isEmpty() && !colorGroups.contains(rule.colorGroup)) {
+            colorGroups.insert(rule.colorGroup, groupNames.size());
+            groupNames << rule.colorGroup;
+        }
+        if (!rule.action.isEmpty() && !actions.contains(rule.action)) {
+            actions.insert(rule.action, actionNames.size());
+            actionNames << rule.action;
+        }
+    }
+
+    KeyStyle defaults;
+    defaults.background = palette.button();
+    defaults.borderColor = palette.color(QPalette::Mid);
+    defaults.text = palette.color(QPalette::ButtonText);
+
+    table.resize(groupNames.size() * actionNames.size() * StateCount);
+    for (int g=0; g<groupNames.size(); g++) {
+        for (int a=0; a<actionNames.size(); a++) {
+            for (int state=0; state<StateCount; state++) {
+                KeyStyle style = defaults;
+                for (const Rule &rule : std::as_const(rules)) {
+                    if (!rule.colorGroup.isEmpty() && rule.colorGroup != groupNames.at(g)) continue;
+                    if (!rule.action.isEmpty() && rule.action != actionNames.at(a)) continue;
+                    if (rule.states & ~state) continue;
+                    applyRule(style, rule);
+                }
+                table[(g * actionNames.size() + a) * StateCount + state] = style;
+            }
+        }
+    }
+
+    id = ++s_serial;
+}
+
+const ColorStyle::KeyStyle &ColorStyle::keyStyle(const QString& colorGroup, const QString& action, int state) const
+{
+    return keyStyle(styleKey(colorGroup, action), state);
+}
+
+int ColorStyle::styleKey(const QString& colorGroup, const QString& action) const
+{
+    int g = colorGroups.value(colorGroup, 0);
+    int a = actions.value(action, 0);
+    return (g * (actions.size() + 1) + a) * StateCount;
+}
+
+const ColorStyle::KeyStyle &ColorStyle::keyStyle(int styleKey, int state) const
+{
+    return table.at(styleKey + (state & (StateCount - 1)));
+}
+
+const QBrush &ColorStyle::windowBackground() const
+{
+    return background;
+}
+
+int ColorStyle::windowRadius() const
+{
+    return radius;
+}
+
+quint64 ColorStyle::serial() const
+{
+    return id;
+}
+
+void ColorStyle::paintKey(QPainter *painter, const QRectF& rect, const KeyStyle& style, const QString& text)
+{
+    QRectF box = rect.adjusted(style.margin, style.margin, -style.margin, -style.margin);
+    int borderWidth = style.borderStyle == NoBorder ? 0 : style.borderWidth;
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+
+    if (borderWidth > 0) {
+        //a flat approximation of the 3D inset and outset borders
+        QColor borderColor = style.borderStyle == InsetBorder ? style.borderColor.darker(130) : style.borderColor;
+        painter->setPen(QPen(borderColor, borderWidth));
+        qreal half = borderWidth / 2.0;
+        box.adjust(half, half, -half, -half);
+    }
+    else {
+        painter->setPen(Qt::NoPen);
+    }
+    painter->setBrush(style.background);
+    painter->drawRoundedRect(box, style.radius, style.radius);
+
+    painter->setPen(style.text);
+    painter->drawText(rect, Qt::AlignCenter | Qt::TextShowMnemonic, text);
+    painter->restore();
+}
+
+const ColorStyle *ColorStyle::active()
+{
+    return s_active;
+}
+
+void ColorStyle::setActive(const ColorStyle *style)
+{
+    s_active = style;
+}
@@ -0,0 +1,113 @@
+// Class ColorStyle: color stylesheet compiled into a table of key styles
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef COLORSTYLE_H
+#define COLORSTYLE_H
+
+#include <QBrush>
+#include <QColor>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class QPainter;
+class QPalette;
+class QRectF;
+
+/**
+ * Class ColorStyle:
+ * Reads one of the color stylesheets and resolves its rules once into a
+ * typed table of brushes, border and text colors, radii and margins for
+ * every colorGroup × action × button state the file mentions. Keys are
+ * then painted straight from the table, which avoids the Qt stylesheet
+ * engine and its re-polish of every button on each color change.
+ *
+ * Only the subset of CSS used by the shipped color files is understood:
+ * VButton rules with colorGroup and action attribute selectors and the
+ * pressed, checked and hover states, and the QWidget[name="main"] rule
+ * for the window background.
+ */
+class ColorStyle
+{
+public:
+    enum State {
+        Pressed = 0x1,
+        Checked = 0x2,
+        Hover = 0x4,
+        StateCount = 8
+    };
+
+    enum BorderStyle {
+        NoBorder,
+        SolidBorder,
+        InsetBorder,
+        OutsetBorder
+    };
+
+    struct KeyStyle
+    {
+        QBrush background;
+        QColor borderColor;
+        QColor text;
+        int borderWidth = 1;
+        int borderStyle = SolidBorder;
+        int radius = 3;
+        int margin = 1;
+    };
+
+    ColorStyle();
+
+    bool load(const QString& fileName);
+    void parse(const QString& css);
+
+    /**
+     * As above with the defaults taken from @p palette instead of the
+     * application palette, for parsing off the GUI thread.
+     */
+    bool load(const QString& fileName, const QPalette& palette);
+    void parse(const QString& css, const QPalette& palette);
+
+    /**
+     * @param state combination of State flags
+     */
+    const KeyStyle &keyStyle(const QString& colorGroup, const QString& action, int state) const;
+
+    /**
+     * Resolves @p colorGroup and @p action to a key for keyStyle(int, int),
+     * valid until the next parse.
+     */
+    int styleKey(const QString& colorGroup, const QString& action) const;
+    const KeyStyle &keyStyle(int styleKey, int state) const;
+
+    const QBrush &windowBackground() const;
+    int windowRadius() const;
+
+    /**
+     * @return an id that changes each time a style is parsed
+     */
+    quint64 serial() const;
+
+    static void paintKey(QPainter *painter, const QRectF& rect, const KeyStyle& style, const QString& text);
+
+    /**
+     * The style keys and windows are painted with, nullptr when the
+     * color stylesheets are applied instead.
+     */
+    static const ColorStyle *active();
+    static void setActive(const ColorStyle *style);
+
+protected:
+    QHash<QString, int> colorGroups;
+    QHash<QString, int> actions;
+    //indexed by (colorGroup * actions + action) * StateCount + state
+    QVector<KeyStyle> table;
+
+    QBrush background;
+    int radius;
+    quint64 id;
+
+    static const ColorStyle *s_active;
+};
+
+#endif // COLORSTYLE_H
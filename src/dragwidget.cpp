@@ -1,16 +1,28 @@
 #include "dragwidget.h"
 
+#include <QGuiApplication>
 #include <QPainter>
+#include <QScreen>
 #include <QStyleOption>
 #include <QStylePainter>
+#include <QTimer>
+#include <QWindow>
+
+#include "colorstyle.h"
+#include "x11connection.h"
 
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 
 DragWidget::DragWidget(QWidget *parent) :
-    QWidget(parent),  dragged(false), moved(false), locked(false)
+    QWidget(parent),  dragged(false), moved(false), locked(false), movePending(false)
 {
     setAttribute(Qt::WA_TranslucentBackground);
+
+    frameTimer = new QTimer(this);
+    frameTimer->setSingleShot(true);
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    connect(frameTimer, SIGNAL(timeout()), this, SLOT(frameElapsed()));
 }
 
 DragWidget::~DragWidget()
@@ -21,7 +33,9 @@ void DragWidget::blurBackground(bool blurEnabled)
 {
     this->setProperty("blurBackground", QVariant(blurEnabled));
 
-    Display *dpy = XOpenDisplay(nullptr);
+    Display *dpy = X11Connection::display();
+    if (!dpy) return;
+
     Atom net_wm_blur_region = XInternAtom(dpy, "_KDE_NET_WM_BLUR_BEHIND_REGION", False);
 
     if (blurEnabled) {
@@ -30,8 +44,8 @@ void DragWidget::blurBackground(bool blurEnabled)
         XDeleteProperty(dpy, this->winId(), net_wm_blur_region);
     }
 
+    XFlush(dpy);
     repaint();
-    XCloseDisplay(dpy);
 }
 void DragWidget::setLocked(bool locked)
 {
@@ -58,18 +72,72 @@ void DragWidget::mouseMoveEvent(QMouseEvent *ev)
     if (!dragged) return;
     moved = true;
 
-    QPoint curr(ev->globalPos().x() - dragPoint.x(), ev->globalPos().y() - dragPoint.y());
-    move(curr);
+    pendingPos = QPoint(ev->globalPos().x() - dragPoint.x(), ev->globalPos().y() - dragPoint.y());
+    movePending = true;
+    scheduleGeometry();
 }
 
 void DragWidget::mouseReleaseEvent(QMouseEvent *)
 {
+    //the last motion may still be waiting for the frame to end
+    frameTimer->stop();
+    applyGeometry();
+
     dragged = false;
     moved = false;
 }
 
+void DragWidget::scheduleGeometry()
+{
+    if (frameTimer->isActive()) {
+        return;
+    }
+
+    if (applyGeometry()) {
+        frameTimer->start(frameInterval());
+    }
+}
+
+void DragWidget::frameElapsed()
+{
+    //keep rate limiting while motion continues, go idle once it stops
+    if (applyGeometry()) {
+        frameTimer->start(frameInterval());
+    }
+}
+
+bool DragWidget::applyGeometry()
+{
+    if (!movePending) {
+        return false;
+    }
+
+    movePending = false;
+    move(pendingPos);
+    return true;
+}
+
+int DragWidget::frameInterval() const
+{
+    QScreen *screen = windowHandle() ? windowHandle()->screen() : QGuiApplication::primaryScreen();
+    qreal rate = screen ? screen->refreshRate() : 0.0;
+    if (rate < 1.0) {
+        rate = 60.0;
+    }
+    return qMax(1, qRound(1000.0 / rate));
+}
+
 void DragWidget::paintEvent(QPaintEvent *)
 {
+    if (const ColorStyle *colors = ColorStyle::active()) {
+        QPainter p(this);
+        p.setRenderHint(QPainter::Antialiasing);
+        p.setPen(Qt::NoPen);
+        p.setBrush(colors->windowBackground());
+        p.drawRoundedRect(rect(), colors->windowRadius(), colors->windowRadius());
+        return;
+    }
+
     QStyleOption opt;
     opt.initFrom(this);
     QStylePainter p(this);
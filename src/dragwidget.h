@@ -5,6 +5,8 @@
 #include <QPoint>
 #include <QMouseEvent>
 
+class QTimer;
+
 class DragWidget : public QWidget
 {
     Q_OBJECT
@@ -19,7 +21,29 @@ public Q_SLOTS:
     void setLocked(bool mode);
     bool isLocked();
 
+protected Q_SLOTS:
+    void frameElapsed();
+
 protected:
+    /**
+     * Applies the pending geometry now if no update was done during the
+     * current frame, otherwise once the frame elapses. Motion events
+     * arrive much faster than the screen refreshes, so at most one
+     * move or resize is done per refresh.
+     */
+    void scheduleGeometry();
+
+    /**
+     * Applies the pending geometry.
+     * @return true if the widget was moved or resized
+     */
+    virtual bool applyGeometry();
+
+    /**
+     * @return the refresh period of the screen showing the widget in ms
+     */
+    int frameInterval() const;
+
     void mouseMoveEvent(QMouseEvent * e) override;
     void mousePressEvent(QMouseEvent * e) override;
     void mouseReleaseEvent(QMouseEvent * e) override;
@@ -32,6 +56,10 @@ protected:
     bool moved;
     bool locked;
 
+    QTimer *frameTimer;
+    QPoint pendingPos;
+    bool movePending;
+
 Q_SIGNALS:
     void widgetShown();
 };
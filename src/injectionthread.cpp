@@ -0,0 +1,125 @@
+// Class InjectionThread: key injection off the GUI thread
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "injectionthread.h"
+#include "metrics.h"
+#include "x11connection.h"
+
+#include <QDebug>
+
+InjectionThread::InjectionThread(QObject *parent) : QThread(parent), delay(0), events(0)
+{
+    setObjectName(QLatin1String("KvkbdInjection"));
+}
+
+InjectionThread::~InjectionThread()
+{
+    stop();
+}
+
+bool InjectionThread::enqueue(const KeyStroke &stroke)
+{
+    if (!queue.push(stroke)) {
+        return false;
+    }
+    pending.release();
+    return true;
+}
+
+void InjectionThread::setEventDelay(unsigned long delay)
+{
+    this->delay.store(delay, std::memory_order_relaxed);
+}
+
+void InjectionThread::stop()
+{
+    if (!isRunning()) return;
+
+    requestInterruption();
+    pending.release();
+    wait();
+}
+
+quint64 InjectionThread::eventCount() const
+{
+    return events.load(std::memory_order_relaxed);
+}
+
+void InjectionThread::run()
+{
+    Display *display = X11Connection::openPrivate();
+    if (!display) {
+        qWarning() << "InjectionThread: unable to open the X display, keys will not be sent";
+    }
+    keyInjector.setDisplay(display);
+
+    QVector<KeyEvent> batch;
+    QVector<unsigned int> sent;
+    QVector<KeyStroke> taps;
+    KeyStroke stroke;
+
+    while (true) {
+        pending.acquire();
+
+        // Every stroke is released once, take all that are already queued
+        int strokes = 1 + pending.available();
+        pending.tryAcquire(strokes - 1);
+
+        batch.clear();
+        sent.clear();
+        taps.clear();
+        keyInjector.setEventDelay(delay.load(std::memory_order_relaxed));
+
+        for (int a = 0; a < strokes && queue.pop(stroke); a++) {
+            if (stroke.type == KeyStroke::Remap || stroke.type == KeyStroke::Sync) {
+                // The keys before the remap go out first, on this connection
+                // the server generates them with the old mapping
+                if (!batch.isEmpty()) {
+                    keyInjector.send(batch);
+                    events.fetch_add(batch.size(), std::memory_order_relaxed);
+                    batch.clear();
+                }
+                if (stroke.type == KeyStroke::Remap) {
+                    keyInjector.remapKey(stroke.keyCode, stroke.keySym);
+                }
+                else {
+                    keyInjector.sync();
+                }
+                continue;
+            }
+
+            KeyInjector::appendKeyStroke(batch, stroke);
+            if (stroke.type == KeyStroke::Click || stroke.type == KeyStroke::Release) {
+                sent << stroke.keyCode;
+            }
+            if (stroke.type == KeyStroke::Click || stroke.type == KeyStroke::Press) {
+                taps << stroke;
+            }
+        }
+
+        if (!batch.isEmpty()) {
+            keyInjector.send(batch);
+            events.fetch_add(batch.size(), std::memory_order_relaxed);
+        }
+
+        qint64 flushedAt = KeyInjector::now();
+        for (const KeyStroke &tap : std::as_const(taps)) {
+            Metrics::record(Metrics::Inject, flushedAt - tap.queuedAt);
+            if (tap.inputAt > 0) {
+                Metrics::record(Metrics::Total, flushedAt - tap.inputAt);
+            }
+        }
+
+        for (unsigned int keyCode : sent) {
+            Q_EMIT keySent(keyCode);
+        }
+
+        if (isInterruptionRequested() && queue.isEmpty()) {
+            break;
+        }
+    }
+
+    keyInjector.setDisplay(nullptr);
+    X11Connection::closePrivate(display);
+}
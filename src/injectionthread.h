@@ -0,0 +1,67 @@
+// Class InjectionThread: key injection off the GUI thread
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef INJECTIONTHREAD_H
+#define INJECTIONTHREAD_H
+
+#include <QSemaphore>
+#include <QThread>
+
+#include <atomic>
+
+#include "keyinjector.h"
+#include "spscring.h"
+
+/**
+ * Class InjectionThread:
+ * Worker thread that owns its own X connection and injects the keystrokes
+ * queued by the GUI thread, in order. The queue is a lock-free single
+ * producer/single consumer ring, so a busy X server stalls only this
+ * thread and never the keyboard UI. Everything queued while the worker
+ * was busy is sent as one batch. Remap strokes change the keyboard
+ * mapping on the same connection, in order with the keys around them.
+ */
+class InjectionThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit InjectionThread(QObject *parent = nullptr);
+    ~InjectionThread();
+
+    /**
+     * Queues @p stroke. GUI thread only.
+     *
+     * @return false if the queue is full
+     */
+    bool enqueue(const KeyStroke &stroke);
+
+    void setEventDelay(unsigned long delay);
+
+    /**
+     * Sends what is still queued, then ends the thread.
+     */
+    void stop();
+
+    /**
+     * @return the number of key events sent so far, from any thread
+     */
+    quint64 eventCount() const;
+
+Q_SIGNALS:
+    //emitted from the worker thread once the key has been flushed and
+    //released, not for the press of a key that is held down
+    void keySent(unsigned int keyCode);
+
+protected:
+    void run() override;
+
+    SpscRing<KeyStroke, 256> queue;
+    QSemaphore pending;
+    std::atomic<unsigned long> delay;
+    std::atomic<quint64> events;
+    KeyInjector keyInjector;
+};
+
+#endif // INJECTIONTHREAD_H
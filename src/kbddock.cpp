@@ -24,8 +24,6 @@
 
 #include <QDBusConnection>
 #include <QPainter>
-#include <QGuiApplication>
-#include <QScreen>
 #include <QWidget>
 #include <QMouseEvent>
 
@@ -55,9 +53,35 @@ KbdDock::~KbdDock()
 
 void KbdDock::paintEvent(QPaintEvent *)
 {
-     QPixmap pix = QGuiApplication::primaryScreen()->grabWindow(wID);
+     if (pm.isNull()) return;
+
      QPainter p(this);
-     p.drawPixmap(0, 0, pix.scaled(width(), height(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+     p.drawPixmap(0, 0, pm);
+}
+
+void KbdDock::setPixmap(const QPixmap& pm)
+{
+    source = pm;
+    scalePixmap();
+    update();
+}
+
+void KbdDock::resizeEvent(QResizeEvent *ev)
+{
+    DragWidget::resizeEvent(ev);
+    scalePixmap();
+}
+
+void KbdDock::scalePixmap()
+{
+    if (source.isNull()) {
+        pm = QPixmap();
+        return;
+    }
+
+    qreal ratio = devicePixelRatioF();
+    pm = source.scaled(size() * ratio, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    pm.setDevicePixelRatio(ratio);
 }
 
 void KbdDock::mouseReleaseEvent(QMouseEvent *ev)
@@ -37,6 +37,11 @@ public:
     ~KbdDock();
 
     void paintEvent(QPaintEvent *) override;
+
+    /**
+     * Sets the picture of the keyboard shown by the dock. It is scaled
+     * once here and on resize, paints only blit the scaled copy.
+     */
     void setPixmap(const QPixmap& pm);
 
 Q_SIGNALS:
@@ -44,7 +49,12 @@ Q_SIGNALS:
 
 protected:
     void mouseReleaseEvent(QMouseEvent *ev) override;
+    void resizeEvent(QResizeEvent *ev) override;
+    void scalePixmap();
+
     WId wID;
+    //keyboard picture as rendered and scaled to the dock size
+    QPixmap source;
     QPixmap pm;
 };
 
@@ -0,0 +1,461 @@
+// Class KeyboardSurface: keyboard part painted as a single widget
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "keyboardsurface.h"
+#include "metrics.h"
+#include "vbutton.h"
+
+#include <QHelpEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QStyle>
+#include <QTimer>
+#include <QToolTip>
+
+//edge of a hit test cell, in pixels
+#define GRID_CELL 16
+
+KeyboardSurface::KeyboardSurface(QWidget *parent) : MainWidget(parent),
+    gridColumns(0),
+    gridRows(0),
+    pressedKey(-1),
+    heldKey(-1),
+    hoverKey(-1),
+    pressedInside(false),
+    faceSerial(0)
+{
+    setMouseTracking(true);
+    setAttribute(Qt::WA_AlwaysShowToolTips);
+
+    keyTimer = new QTimer(this);
+    connect(keyTimer, SIGNAL(timeout()), this, SLOT(repeatKey()));
+
+    //never shown, only rendered into the face cache
+    prototype = new VButton(this);
+    prototype->hide();
+}
+
+void KeyboardSurface::addKey(const KeyDescriptor &key)
+{
+    Key record;
+    record.desc = key;
+    record.text = key.label;
+    keys.append(record);
+    baseRects.append(key.rect);
+}
+
+int KeyboardSurface::keyCount() const
+{
+    return keys.count();
+}
+
+bool KeyboardSurface::isActionChecked(const QString &action) const
+{
+    for (const Key &key : keys) {
+        if (key.checked && key.desc.action == action) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QList<unsigned int> KeyboardSurface::checkedModifiers() const
+{
+    QList<unsigned int> keyCodes;
+    for (const Key &key : keys) {
+        if (key.checked && key.desc.isModifier()) {
+            keyCodes << key.desc.keyCode;
+        }
+    }
+    return keyCodes;
+}
+
+void KeyboardSurface::releaseModifiers()
+{
+    for (int a=0; a<keys.count(); a++) {
+        if (!keys[a].checked || !keys[a].desc.isModifier()) continue;
+
+        setChecked(a, false);
+        if (keys[a].desc.action.length()>0) {
+            Q_EMIT buttonAction(keys[a].desc.action);
+        }
+    }
+}
+
+void KeyboardSurface::textSwitch(bool setShift)
+{
+    for (Key &key : keys) {
+        if (key.buttonText.count()<1) continue;
+        key.textIndex = setShift ? 1 : 0;
+        key.shift = setShift;
+        updateText(key);
+    }
+    update();
+}
+
+void KeyboardSurface::updateLayout(int, const QString& layout_name)
+{
+    VKeyboard *vkbd = (VKeyboard*)QObject::sender();
+
+    for (Key &key : keys) {
+        if (key.desc.label.length()<1) {
+            ButtonText text;
+            vkbd->textForKeyCode(key.desc.keyCode, text);
+            key.buttonText = text;
+            updateText(key);
+        }
+
+        if (key.desc.name == QLatin1String("currentLayout")) {
+            key.text = layout_name;
+        }
+    }
+    update();
+}
+
+void KeyboardSurface::updateGroupState(const ModifierGroupStateMap& stateMap)
+{
+    ModifierGroupStateMapIterator itr(stateMap);
+
+    while (itr.hasNext()) {
+        itr.next();
+        const QString &group_name = itr.key();
+        bool state = itr.value();
+
+        for (int a=0; a<keys.count(); a++) {
+            Key &key = keys[a];
+
+            if (key.desc.groupToggle == group_name) {
+                if (key.desc.groupLabel.length()>0 && key.desc.label.length()>0) {
+                    key.text = state ? key.desc.groupLabel : key.desc.label;
+                }
+            }
+            else if (group_name == QLatin1String("capslock")) {
+                if (key.buttonText.count()>0) {
+                    key.caps = state;
+                }
+                updateText(key);
+            }
+
+            if (key.desc.groupName == group_name) {
+                setChecked(a, state);
+            }
+        }
+    }
+    update();
+}
+
+void KeyboardSurface::repeatKey()
+{
+    if (keyTimer->interval() == VButton::RepeatLongDelay) {
+        keyTimer->setInterval(VButton::RepeatShortDelay);
+    }
+
+    if (pressedKey >= 0) {
+        Q_EMIT keyClick(keys.at(pressedKey).desc.keyCode);
+    }
+}
+
+bool KeyboardSurface::event(QEvent *ev)
+{
+    if (ev->type() == QEvent::ToolTip) {
+        QHelpEvent *help = static_cast<QHelpEvent*>(ev);
+        int index = keyAt(help->pos());
+        if (index >= 0 && keys.at(index).desc.tooltip.length()>0) {
+            QToolTip::showText(help->globalPos(), keys.at(index).desc.tooltip, this, keys.at(index).rect);
+        }
+        else {
+            QToolTip::hideText();
+            ev->ignore();
+        }
+        return true;
+    }
+    return MainWidget::event(ev);
+}
+
+void KeyboardSurface::changeEvent(QEvent *ev)
+{
+    if (ev->type() == QEvent::StyleChange || ev->type() == QEvent::FontChange) {
+        clearCache();
+        update();
+    }
+    MainWidget::changeEvent(ev);
+}
+
+void KeyboardSurface::paintEvent(QPaintEvent *ev)
+{
+    QPainter painter(this);
+    const QRect &dirty = ev->rect();
+
+    for (int a=0; a<keys.count(); a++) {
+        const QRect &rect = keys.at(a).rect;
+        if (!rect.isEmpty() && rect.intersects(dirty)) {
+            painter.drawPixmap(rect.topLeft(), keyFace(a));
+        }
+    }
+}
+
+void KeyboardSurface::resizeEvent(QResizeEvent *ev)
+{
+    const QVector<QRect> rects = keyRects(ev->size());
+
+    for (int a=0; a<keys.count(); a++) {
+        keys[a].rect = rects.at(a);
+    }
+
+    //faces are painted at the key size; a font change clears them through changeEvent
+    clearCache();
+    buildGrid();
+    if (fontFollowsSize()) {
+        updateFont(this->parentWidget()->font());
+    }
+}
+
+void KeyboardSurface::mousePressEvent(QMouseEvent *ev)
+{
+    int index = keyAt(ev->pos());
+    if (index < 0) return;
+
+    Metrics::inputStarted();
+
+    const Key &key = keys.at(index);
+
+    if (ev->button() == Qt::LeftButton) {
+        pressedKey = index;
+        pressedInside = true;
+        updateKey(index);
+    }
+
+    if (key.desc.keyCode>0 && !key.desc.isModifier() && VButton::ServerRepeat && !key.desc.isCheckable()) {
+        if (heldKey < 0) {
+            heldKey = index;
+            Metrics::keyEmitted();
+            Q_EMIT keyDown(key.desc.keyCode);
+        }
+    }
+    else if (key.desc.keyCode>0 && !key.desc.isModifier()) {
+        Metrics::keyEmitted();
+        Q_EMIT keyClick(key.desc.keyCode);
+
+        if (!key.desc.isCheckable() && !keyTimer->isActive()) {
+            pressedKey = index;
+            //200 ms is a bit more that the time needed for a single click
+            keyTimer->start(VButton::RepeatLongDelay);
+        }
+    }
+}
+
+void KeyboardSurface::mouseMoveEvent(QMouseEvent *ev)
+{
+    int index = keyAt(ev->pos());
+    if (index != hoverKey) {
+        int previous = hoverKey;
+        hoverKey = index;
+        updateKey(previous);
+        updateKey(hoverKey);
+    }
+
+    if (pressedKey >= 0) {
+        bool inside = keys.at(pressedKey).rect.contains(ev->pos());
+        if (inside != pressedInside) {
+            pressedInside = inside;
+            updateKey(pressedKey);
+        }
+    }
+}
+
+void KeyboardSurface::mouseReleaseEvent(QMouseEvent *ev)
+{
+    if (keyTimer->isActive()) keyTimer->stop();
+
+    if (heldKey >= 0) {
+        Q_EMIT keyUp(keys.at(heldKey).desc.keyCode);
+        heldKey = -1;
+    }
+
+    int index = pressedKey;
+    pressedKey = -1;
+    if (index < 0) return;
+
+    updateKey(index);
+    if (ev->button() != Qt::LeftButton || !pressedInside) return;
+
+    if (keys.at(index).desc.isCheckable()) {
+        setChecked(index, !keys.at(index).checked);
+    }
+    if (keys.at(index).desc.action.length()>0) {
+        Q_EMIT buttonAction(keys.at(index).desc.action);
+    }
+}
+
+void KeyboardSurface::leaveEvent(QEvent *ev)
+{
+    int previous = hoverKey;
+    hoverKey = -1;
+    updateKey(previous);
+
+    MainWidget::leaveEvent(ev);
+}
+
+int KeyboardSurface::keyAt(const QPoint &pos) const
+{
+    if (pos.x() < 0 || pos.y() < 0) return -1;
+
+    int column = pos.x() / GRID_CELL;
+    int row = pos.y() / GRID_CELL;
+    if (column >= gridColumns || row >= gridRows) return -1;
+
+    int cell = row * gridColumns + column;
+    for (int a=gridStart.at(cell); a<gridStart.at(cell+1); a++) {
+        int index = gridKeys.at(a);
+        if (keys.at(index).rect.contains(pos)) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+int KeyboardSurface::keyState(int index) const
+{
+    int state = 0;
+    if (index == pressedKey && pressedInside) state |= Down;
+    if (keys.at(index).checked) state |= Checked;
+    if (index == hoverKey) state |= Hover;
+    return state;
+}
+
+QPixmap KeyboardSurface::keyFace(int index)
+{
+    const Key &key = keys.at(index);
+    int state = keyState(index);
+
+    const ColorStyle *colors = ColorStyle::active();
+    quint64 serial = colors ? colors->serial() : 0;
+    if (serial != faceSerial) {
+        faceCache.clear();
+        faceSerial = serial;
+    }
+
+    QString cacheKey = key.desc.colorGroup + QLatin1Char('\x1f') + key.desc.action + QLatin1Char('\x1f') + key.text
+                       + QLatin1Char('\x1f') + QString::number(key.rect.width()) + QLatin1Char('x')
+                       + QString::number(key.rect.height()) + QLatin1Char('\x1f') + QString::number(state);
+
+    QPixmap face = faceCache.value(cacheKey);
+    if (!face.isNull()) {
+        return face;
+    }
+
+    qreal ratio = devicePixelRatioF();
+    face = QPixmap(key.rect.size() * ratio);
+    face.setDevicePixelRatio(ratio);
+    face.fill(Qt::transparent);
+
+    if (colors) {
+        QPainter painter(&face);
+        painter.setFont(prototype->font());
+        ColorStyle::paintKey(&painter, QRectF(QPointF(0, 0), QSizeF(key.rect.size())),
+                             colors->keyStyle(key.desc.colorGroup, key.desc.action, state), key.text);
+        faceCache.insert(cacheKey, face);
+        return face;
+    }
+
+    prototype->setProperty("colorGroup", key.desc.colorGroup.isEmpty() ? QVariant() : QVariant(key.desc.colorGroup));
+    prototype->setProperty("action", key.desc.action.isEmpty() ? QVariant() : QVariant(key.desc.action));
+    prototype->setCheckable(key.desc.isCheckable());
+    prototype->setChecked(state & Checked);
+    prototype->setDown(state & Down);
+    prototype->setAttribute(Qt::WA_UnderMouse, state & Hover);
+    prototype->setText(key.text);
+    prototype->resize(key.rect.size());
+
+    //dynamic properties are only matched by the stylesheet on polish
+    prototype->style()->unpolish(prototype);
+    prototype->style()->polish(prototype);
+
+    prototype->render(&face, QPoint(), QRegion(), QWidget::DrawChildren);
+
+    faceCache.insert(cacheKey, face);
+    return face;
+}
+
+void KeyboardSurface::updateText(Key &key)
+{
+    if (key.buttonText.count()<1) return;
+
+    QString text = key.buttonText.at(qMin(key.textIndex, key.buttonText.count()-1));
+    if (text == QLatin1Char('&')) {
+        text += QLatin1Char('&');
+    }
+
+    bool doCaps = key.caps;
+    if (key.shift) doCaps = !doCaps;
+
+    key.text = doCaps ? text.toUpper() : text.toLower();
+}
+
+void KeyboardSurface::setChecked(int index, bool checked)
+{
+    Key &key = keys[index];
+    if (!key.desc.isCheckable() || key.checked == checked) return;
+
+    key.checked = checked;
+    updateKey(index);
+
+    if (key.desc.isModifier()) {
+        Q_EMIT modifierToggled(key.desc.keyCode, checked);
+    }
+}
+
+void KeyboardSurface::updateKey(int index)
+{
+    if (index >= 0) {
+        update(keys.at(index).rect);
+    }
+}
+
+void KeyboardSurface::buildGrid()
+{
+    gridColumns = qMax(1, (width() + GRID_CELL - 1) / GRID_CELL);
+    gridRows = qMax(1, (height() + GRID_CELL - 1) / GRID_CELL);
+
+    int cells = gridColumns * gridRows;
+    gridStart.fill(0, cells + 1);
+
+    auto forEachCell = [this](const QRect &rect, auto visit) {
+        if (rect.isEmpty()) return;
+        int c0 = qBound(0, rect.left() / GRID_CELL, gridColumns - 1);
+        int c1 = qBound(0, rect.right() / GRID_CELL, gridColumns - 1);
+        int r0 = qBound(0, rect.top() / GRID_CELL, gridRows - 1);
+        int r1 = qBound(0, rect.bottom() / GRID_CELL, gridRows - 1);
+        for (int r=r0; r<=r1; r++) {
+            for (int c=c0; c<=c1; c++) {
+                visit(r * gridColumns + c);
+            }
+        }
+    };
+
+    for (const Key &key : keys) {
+        forEachCell(key.rect, [this](int cell) { gridStart[cell + 1]++; });
+    }
+    for (int a=0; a<cells; a++) {
+        gridStart[a + 1] += gridStart[a];
+    }
+
+    gridKeys.resize(gridStart.at(cells));
+    QVector<int> next = gridStart;
+    for (int a=0; a<keys.count(); a++) {
+        forEachCell(keys.at(a).rect, [this, &next, a](int cell) { gridKeys[next[cell]++] = a; });
+    }
+}
+
+void KeyboardSurface::clearCache()
+{
+    faceCache.clear();
+}
+
+void KeyboardSurface::trimCaches()
+{
+    MainWidget::trimCaches();
+    clearCache();
+    faceCache.squeeze();
+}
@@ -0,0 +1,127 @@
+// Class KeyboardSurface: keyboard part painted as a single widget
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef KEYBOARDSURFACE_H
+#define KEYBOARDSURFACE_H
+
+#include <QHash>
+#include <QPixmap>
+#include <QVector>
+
+#include "colorstyle.h"
+#include "keydescriptor.h"
+#include "mainwidget.h"
+
+class QTimer;
+class VButton;
+
+/**
+ * Class KeyboardSurface:
+ * Alternative to the VButton tree of MainWidget. The keys are plain records
+ * in one array, mouse events are routed to them through a grid of cells and
+ * a single paintEvent draws them all. Key faces are painted once per
+ * state from the active ColorStyle, or rendered by a hidden prototype
+ * VButton when the color stylesheets are in use, and kept in a pixmap
+ * cache until the size or style changes.
+ */
+class KeyboardSurface : public MainWidget
+{
+    Q_OBJECT
+
+public:
+    explicit KeyboardSurface(QWidget *parent = nullptr);
+
+    void addKey(const KeyDescriptor &key);
+    int keyCount() const;
+
+    /**
+     * @return true if a checked key triggers @p action
+     */
+    bool isActionChecked(const QString &action) const;
+
+    /**
+     * @return the key codes of the checked modifier keys
+     */
+    QList<unsigned int> checkedModifiers() const;
+
+    /**
+     * Unchecks all modifier keys, as a click on each of them would.
+     */
+    void releaseModifiers();
+
+    void trimCaches() override;
+
+public Q_SLOTS:
+    void textSwitch(bool) override;
+    void updateLayout(int, const QString&) override;
+    void updateGroupState(const ModifierGroupStateMap&) override;
+
+Q_SIGNALS:
+    void keyClick(unsigned int);
+    void keyDown(unsigned int);
+    void keyUp(unsigned int);
+    void buttonAction(const QString& action);
+    void modifierToggled(unsigned int keyCode, bool checked);
+
+protected Q_SLOTS:
+    void repeatKey();
+
+protected:
+    enum KeyState {
+        Down = ColorStyle::Pressed,
+        Checked = ColorStyle::Checked,
+        Hover = ColorStyle::Hover
+    };
+
+    struct Key {
+        KeyDescriptor desc;
+        QRect rect;
+        ButtonText buttonText;
+        int textIndex = 0;
+        bool caps = false;
+        bool shift = false;
+        bool checked = false;
+        QString text;
+    };
+
+    bool event(QEvent *ev) override;
+    void changeEvent(QEvent *ev) override;
+    void paintEvent(QPaintEvent *ev) override;
+    void resizeEvent(QResizeEvent *ev) override;
+    void mousePressEvent(QMouseEvent *ev) override;
+    void mouseMoveEvent(QMouseEvent *ev) override;
+    void mouseReleaseEvent(QMouseEvent *ev) override;
+    void leaveEvent(QEvent *ev) override;
+
+    int keyAt(const QPoint &pos) const;
+    int keyState(int index) const;
+    QPixmap keyFace(int index);
+    void updateText(Key &key);
+    void setChecked(int index, bool checked);
+    void updateKey(int index);
+    void buildGrid();
+    void clearCache();
+
+    QVector<Key> keys;
+
+    //hit test grid, keys overlapping cell c are gridKeys[gridStart[c]..gridStart[c+1])
+    int gridColumns;
+    int gridRows;
+    QVector<int> gridStart;
+    QVector<int> gridKeys;
+
+    int pressedKey;
+    //key sent down while VButton::ServerRepeat is set
+    int heldKey;
+    int hoverKey;
+    bool pressedInside;
+    QTimer *keyTimer;
+
+    VButton *prototype;
+    QHash<QString, QPixmap> faceCache;
+    //ColorStyle the cached faces were painted with, 0 for stylesheets
+    quint64 faceSerial;
+};
+
+#endif // KEYBOARDSURFACE_H
@@ -0,0 +1,42 @@
+// Struct KeyDescriptor: one key as described by a theme
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef KEYDESCRIPTOR_H
+#define KEYDESCRIPTOR_H
+
+#include <QRect>
+#include <QString>
+
+/**
+ * Struct KeyDescriptor:
+ * Everything the theme says about a single key, with the size hints
+ * already resolved. It is the common input of the VButton tree and of the
+ * painted KeyboardSurface.
+ */
+struct KeyDescriptor
+{
+    enum Flag {
+        Modifier = 0x1,
+        Checkable = 0x2
+    };
+
+    //position and size in theme units
+    QRect rect;
+    unsigned int keyCode = 0;
+    unsigned int flags = 0;
+
+    QString name;
+    QString label;
+    QString groupLabel;
+    QString groupToggle;
+    QString groupName;
+    QString colorGroup;
+    QString action;
+    QString tooltip;
+
+    bool isModifier() const { return flags & Modifier; }
+    bool isCheckable() const { return flags & (Modifier | Checkable); }
+};
+
+#endif // KEYDESCRIPTOR_H
@@ -0,0 +1,87 @@
+// Class KeyInjector: batched XTest key event injection
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "keyinjector.h"
+
+#include <chrono>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+
+KeyInjector::KeyInjector() :
+    dpy(nullptr), delay(0)
+{
+}
+
+void KeyInjector::setDisplay(Display *display)
+{
+    dpy = display;
+}
+
+Display *KeyInjector::display() const
+{
+    return dpy;
+}
+
+void KeyInjector::setEventDelay(unsigned long delay)
+{
+    this->delay = delay;
+}
+
+unsigned long KeyInjector::eventDelay() const
+{
+    return delay;
+}
+
+void KeyInjector::appendKeyStroke(QVector<KeyEvent> &batch, const KeyStroke &stroke)
+{
+    bool press = stroke.type != KeyStroke::Release && stroke.type != KeyStroke::Unlatch;
+    bool release = stroke.type != KeyStroke::Press && stroke.type != KeyStroke::Latch;
+
+    if (press) {
+        batch.append({stroke.keyCode, true});
+    }
+    if (release) {
+        batch.append({stroke.keyCode, false});
+    }
+}
+
+bool KeyInjector::send(const QVector<KeyEvent> &batch)
+{
+    if (!dpy || batch.isEmpty()) return false;
+
+    for (const KeyEvent &event : batch) {
+        XTestFakeKeyEvent(dpy, event.keyCode, event.press, delay);
+    }
+    XFlush(dpy);
+    return true;
+}
+
+void KeyInjector::remapKey(unsigned int keyCode, unsigned long keySym)
+{
+    if (!dpy) return;
+
+    KeySym sym = keySym;
+    XChangeKeyboardMapping(dpy, keyCode, 1, &sym, 1);
+
+    // Every client gets a MappingNotify, drop ours, nothing reads this
+    // connection otherwise
+    XEvent event;
+    while (XPending(dpy) > 0) {
+        XNextEvent(dpy, &event);
+    }
+}
+
+void KeyInjector::sync()
+{
+    if (!dpy) return;
+
+    //nothing reads the events of this connection
+    XSync(dpy, True);
+}
+
+qint64 KeyInjector::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
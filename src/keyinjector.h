@@ -0,0 +1,110 @@
+// Class KeyInjector: batched XTest key event injection
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef KEYINJECTOR_H
+#define KEYINJECTOR_H
+
+#include <QVector>
+
+typedef struct _XDisplay Display;
+
+struct KeyEvent
+{
+    unsigned int keyCode;
+    bool press;
+};
+
+/**
+ * One action on a single key as requested by the user interface, or a
+ * Remap or Sync of the injection connection. Fixed size, so it can be
+ * queued between threads without allocating.
+ */
+struct KeyStroke
+{
+    enum Type {
+        //press and release
+        Click,
+        //press only, the key stays down until its Release stroke
+        Press,
+        //release only
+        Release,
+        //press only of a latched modifier, never reported as sent
+        Latch,
+        //release only of a latched modifier, never reported as sent
+        Unlatch,
+        //maps keySym to the key for the strokes that follow, no event
+        Remap,
+        //waits until the server has handled the strokes before, no event
+        Sync
+    };
+
+    unsigned int keyCode;
+    int type;
+    //Remap only
+    unsigned long keySym;
+    qint64 queuedAt;
+    //mouse press that led to the stroke, 0 if none
+    qint64 inputAt;
+};
+
+/**
+ * Class KeyInjector:
+ * Sends batches of fake key events through XTest. A batch holds the
+ * complete event sequence of one or more keystrokes, modifiers included,
+ * and is written with a single flush. XTest requests have no reply, so
+ * sending never waits for the server. The server side delay between
+ * events defaults to zero and is a configurable policy.
+ */
+class KeyInjector
+{
+public:
+    KeyInjector();
+
+    void setDisplay(Display *display);
+    Display *display() const;
+
+    /**
+     * Sets the server side delay inserted before each event, in ms.
+     */
+    void setEventDelay(unsigned long delay);
+    unsigned long eventDelay() const;
+
+    /**
+     * Appends press and release of the stroke's key. Press and Latch
+     * strokes only append the press, Release and Unlatch strokes only
+     * the release.
+     */
+    static void appendKeyStroke(QVector<KeyEvent> &batch, const KeyStroke &stroke);
+
+    /**
+     * Sends @p batch with one flush.
+     */
+    bool send(const QVector<KeyEvent> &batch);
+
+    /**
+     * Maps @p keySym alone to @p keyCode, NoSymbol clears it. On the
+     * connection of the key events, so the server generates the keys sent
+     * before with the old mapping and the keys sent after with the new
+     * one. Clients translate key codes with their own copy of the mapping
+     * though, and may refresh it before they handle the earlier keys.
+     */
+    void remapKey(unsigned int keyCode, unsigned long keySym);
+
+    /**
+     * Round trip to the server: once it returns, the server has generated
+     * and delivered every key event sent before.
+     */
+    void sync();
+
+    /**
+     * @return a monotonic timestamp in ns, usable from any thread
+     */
+    static qint64 now();
+
+protected:
+    Display *dpy;
+    unsigned long delay;
+};
+
+#endif // KEYINJECTOR_H
@@ -0,0 +1,252 @@
+// Class KeymapCache: client side copy of the XKB keyboard mapping
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "keymapcache.h"
+
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XKBstr.h>
+
+// Option components of the symbols name that are not layouts
+static const char *const nonLayoutSymbols[] = {
+    "pc", "inet", "group", "compose", "level3", "level5", "ctrl", "caps", "altwin",
+    "terminate", "keypad", "kpdl", "nbsp", "eurosign", "rupeesign", "shift", "srvr_ctrl"
+};
+
+KeymapCache::KeymapCache() :
+    minCode(0), maxCode(-1), groups(0), levels(0), builds(0)
+{
+}
+
+bool KeymapCache::rebuild(Display *display)
+{
+    if (!display) return false;
+
+    XkbDescPtr xkb = XkbGetMap(display, XkbKeyTypesMask | XkbKeySymsMask | XkbModifierMapMask, XkbUseCoreKbd);
+    if (!xkb) return false;
+
+    minCode = xkb->min_key_code;
+    maxCode = xkb->max_key_code;
+    groups = XkbNumKbdGroups;
+    levels = 1;
+    for (int keyCode = minCode; keyCode <= maxCode; ++keyCode) {
+        levels = qMax(levels, (int)XkbKeyGroupsWidth(xkb, keyCode));
+    }
+
+    int size = (maxCode - minCode + 1) * groups * levels;
+    keySyms.fill(NoSymbol, size);
+    ucsTable.fill(0, size);
+    modMap.fill(0, maxCode - minCode + 1);
+    ucsKeys.clear();
+
+    for (int keyCode = minCode; keyCode <= maxCode; ++keyCode) {
+        modMap[keyCode - minCode] = xkb->map->modmap[keyCode];
+
+        int keyGroups = XkbKeyNumGroups(xkb, keyCode);
+        if (keyGroups < 1) continue;
+
+        unsigned char groupInfo = XkbKeyGroupInfo(xkb, keyCode);
+
+        for (int group = 0; group < groups; ++group) {
+
+            // Resolve the group the same way the server does for this key
+            int keyGroup = group;
+            if (keyGroup >= keyGroups) {
+                switch (XkbOutOfRangeGroupAction(groupInfo)) {
+                case XkbClampIntoRange:
+                    keyGroup = keyGroups - 1;
+                    break;
+                case XkbRedirectIntoRange:
+                    keyGroup = XkbOutOfRangeGroupNumber(groupInfo);
+                    if (keyGroup >= keyGroups) keyGroup = 0;
+                    break;
+                default:
+                    keyGroup %= keyGroups;
+                    break;
+                }
+            }
+
+            int keyLevels = XkbKeyKeyType(xkb, keyCode, keyGroup)->num_levels;
+            for (int level = 0; level < keyLevels && level < levels; ++level) {
+                KeySym sym = XkbKeySymEntry(xkb, keyCode, level, keyGroup);
+                int pos = index(keyCode, group, level);
+                keySyms[pos] = sym;
+                ucsTable[pos] = (unsigned int)kconvert.convert(sym);
+
+                if (ucsTable[pos] == 0) continue;
+                quint64 ucsKey = ((quint64)group << 32) | ucsTable[pos];
+                auto itr = ucsKeys.find(ucsKey);
+                if (itr == ucsKeys.end()) {
+                    ucsKeys.insert(ucsKey, ((quint32)level << 16) | (quint32)keyCode);
+                }
+                else if ((int)(itr.value() >> 16) > level) {
+                    itr.value() = ((quint32)level << 16) | (quint32)keyCode;
+                }
+            }
+        }
+    }
+
+    groupNames.clear();
+    layoutNames.clear();
+    for (int group = 0; group < groups; ++group) {
+        groupNames << QString();
+        layoutNames << QString();
+    }
+
+    if (XkbGetNames(display, XkbGroupNamesMask | XkbSymbolsNameMask, xkb) == Success && xkb->names) {
+        for (int group = 0; group < groups; ++group) {
+            if (xkb->names->groups[group] == None) continue;
+            char *name = XGetAtomName(display, xkb->names->groups[group]);
+            if (name) {
+                groupNames[group] = QString::fromUtf8(name);
+                XFree(name);
+            }
+        }
+
+        char *symbols = xkb->names->symbols != None ? XGetAtomName(display, xkb->names->symbols) : nullptr;
+        if (symbols) {
+            // e.g. "pc+us+ru:2+inet(evdev)+group(alt_shift_toggle)"
+            const QStringList parts = QString::fromLatin1(symbols).split(QLatin1Char('+'));
+            for (const QString &part : parts) {
+                QString layout = part.section(QLatin1Char(':'), 0, 0).section(QLatin1Char('('), 0, 0);
+                bool isLayout = !layout.isEmpty();
+                for (const char *option : nonLayoutSymbols) {
+                    if (layout == QLatin1String(option)) isLayout = false;
+                }
+                if (!isLayout) continue;
+
+                int group = part.contains(QLatin1Char(':')) ? part.section(QLatin1Char(':'), 1).toInt() - 1 : 0;
+                if (group >= 0 && group < groups && layoutNames.at(group).isEmpty()) {
+                    layoutNames[group] = layout;
+                }
+            }
+            XFree(symbols);
+        }
+    }
+
+    XkbFreeKeyboard(xkb, 0, True);
+
+    builds++;
+    return true;
+}
+
+bool KeymapCache::isValid() const
+{
+    return maxCode >= minCode;
+}
+
+int KeymapCache::minKeyCode() const
+{
+    return minCode;
+}
+
+int KeymapCache::maxKeyCode() const
+{
+    return maxCode;
+}
+
+int KeymapCache::groupCount() const
+{
+    return groups;
+}
+
+int KeymapCache::levelCount() const
+{
+    return levels;
+}
+
+int KeymapCache::index(unsigned int keyCode, int group, int level) const
+{
+    if ((int)keyCode < minCode || (int)keyCode > maxCode) return -1;
+    if (level < 0 || level >= levels || groups < 1) return -1;
+
+    // XKB state groups are always normalised, but be tolerant of layout indices
+    group = qAbs(group) % groups;
+
+    return ((keyCode - minCode) * groups + group) * levels + level;
+}
+
+unsigned long KeymapCache::keySym(unsigned int keyCode, int group, int level) const
+{
+    int pos = index(keyCode, group, level);
+    return pos < 0 ? NoSymbol : keySyms.at(pos);
+}
+
+unsigned int KeymapCache::ucs(unsigned int keyCode, int group, int level) const
+{
+    int pos = index(keyCode, group, level);
+    return pos < 0 ? 0 : ucsTable.at(pos);
+}
+
+bool KeymapCache::findUcs(unsigned int ucs, int group, unsigned int *keyCode, int *level) const
+{
+    if (groups < 1) return false;
+
+    auto itr = ucsKeys.constFind(((quint64)(qAbs(group) % groups) << 32) | ucs);
+    if (itr == ucsKeys.constEnd()) return false;
+
+    *keyCode = itr.value() & 0xffff;
+    *level = itr.value() >> 16;
+    return true;
+}
+
+unsigned int KeymapCache::keyCodeForKeySym(unsigned long sym, int group) const
+{
+    for (int keyCode = minCode; keyCode <= maxCode; ++keyCode) {
+        if (keySym(keyCode, group, 0) == sym) {
+            return keyCode;
+        }
+    }
+    return 0;
+}
+
+QVector<unsigned int> KeymapCache::spareKeyCodes() const
+{
+    QVector<unsigned int> spare;
+    int width = groups * levels;
+
+    for (int keyCode = minCode; keyCode <= maxCode; ++keyCode) {
+        int first = (keyCode - minCode) * width;
+        bool used = false;
+        for (int a = first; a < first + width && !used; ++a) {
+            used = keySyms.at(a) != NoSymbol;
+        }
+        if (!used) {
+            spare << keyCode;
+        }
+    }
+    return spare;
+}
+
+unsigned int KeymapCache::modifierMask(unsigned int keyCode) const
+{
+    if ((int)keyCode < minCode || (int)keyCode > maxCode) return 0;
+    return modMap.at(keyCode - minCode);
+}
+
+unsigned int KeymapCache::modifiersForKeySym(unsigned long sym) const
+{
+    unsigned int mask = 0;
+    for (int a = 0; a < keySyms.size(); ++a) {
+        if (keySyms.at(a) == sym) {
+            mask |= modMap.at(a / (groups * levels));
+        }
+    }
+    return mask;
+}
+
+QString KeymapCache::groupName(int group) const
+{
+    return groupNames.value(group);
+}
+
+QString KeymapCache::layoutName(int group) const
+{
+    return layoutNames.value(group);
+}
+
+quint64 KeymapCache::buildCount() const
+{
+    return builds;
+}
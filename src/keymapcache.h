@@ -0,0 +1,118 @@
+// Class KeymapCache: client side copy of the XKB keyboard mapping
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef KEYMAPCACHE_H
+#define KEYMAPCACHE_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "keysymconvert.h"
+
+typedef struct _XDisplay Display;
+
+/**
+ * Class KeymapCache:
+ * Flat keycode x group x level table of keysyms and their UCS code points,
+ * built with one XkbGetMap/XkbGetNames exchange. Lookups never talk to the
+ * server, the owner rebuilds the table when XKB reports a new keymap.
+ * Out of range groups are resolved per key with the key's own group wrap
+ * rule, so every group index can be looked up for every key.
+ */
+class KeymapCache
+{
+public:
+    KeymapCache();
+
+    /**
+     * Reloads the keyboard mapping of the core keyboard.
+     *
+     * @return false if the server did not return a mapping
+     */
+    bool rebuild(Display *display);
+
+    bool isValid() const;
+
+    int minKeyCode() const;
+    int maxKeyCode() const;
+    int groupCount() const;
+    int levelCount() const;
+
+    /**
+     * @return the keysym at @p group and shift @p level, NoSymbol if none
+     */
+    unsigned long keySym(unsigned int keyCode, int group, int level) const;
+
+    /**
+     * @return the UCS code point at @p group and shift @p level, 0 if none
+     */
+    unsigned int ucs(unsigned int keyCode, int group, int level) const;
+
+    /**
+     * Finds the key producing the UCS code point @p ucs in @p group,
+     * preferring the lowest shift level.
+     *
+     * @return false if no key of the group produces it
+     */
+    bool findUcs(unsigned int ucs, int group, unsigned int *keyCode, int *level) const;
+
+    /**
+     * @return a key producing @p keySym at the first level of @p group, 0 if none
+     */
+    unsigned int keyCodeForKeySym(unsigned long keySym, int group) const;
+
+    /**
+     * @return the key codes without any keysym, free to be remapped
+     */
+    QVector<unsigned int> spareKeyCodes() const;
+
+    /**
+     * @return the real modifier mask bound to @p keyCode
+     */
+    unsigned int modifierMask(unsigned int keyCode) const;
+
+    /**
+     * @return the real modifiers bound to any key producing @p keySym
+     */
+    unsigned int modifiersForKeySym(unsigned long keySym) const;
+
+    /**
+     * @return the descriptive name of @p group, e.g. "English (US)"
+     */
+    QString groupName(int group) const;
+
+    /**
+     * @return the layout of @p group from the symbols name, e.g. "us"
+     */
+    QString layoutName(int group) const;
+
+    /**
+     * @return how many times the table was built since startup
+     */
+    quint64 buildCount() const;
+
+protected:
+    int index(unsigned int keyCode, int group, int level) const;
+
+    KeySymConvert kconvert;
+
+    int minCode;
+    int maxCode;
+    int groups;
+    int levels;
+
+    QVector<unsigned long> keySyms;
+    QVector<unsigned int> ucsTable;
+    QVector<unsigned char> modMap;
+    //(group << 32 | ucs) to (level << 16 | keyCode)
+    QHash<quint64, quint32> ucsKeys;
+    QStringList groupNames;
+    QStringList layoutNames;
+
+    quint64 builds;
+};
+
+#endif // KEYMAPCACHE_H
@@ -12,7 +12,11 @@
 class KeySymConvert
 {
 public:
-    long convert(KeySym keysym);
+    /* keysym -> UCS, 0 if the keysym has no character */
+    long convert(KeySym keysym) const;
+
+    /* UCS -> keysym, the lowest keysym producing the character */
+    KeySym fromUcs(long ucs) const;
 };
 
 #endif // KEYSYM2UCS_H
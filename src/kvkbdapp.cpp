@@ -21,6 +21,7 @@
 
 #include "kvkbdapp.h"
 
+#include <QDBusConnection>
 #include <QDebug>
 #include <QDomDocument>
 #include <QFile>
@@ -31,6 +32,7 @@
 #include <QAction>
 #include <QFileInfo>
 #include <QDir>
+#include <QPixmapCache>
 #include <QScreen>
 
 #include <KAboutData>
@@ -46,21 +48,54 @@ QList<VButton*> modKeys;
 
 #define DEFAULT_WIDTH 	640
 #define DEFAULT_HEIGHT 	210
+//ms to gather content changes before the dock picture is rendered
+#define DOCK_UPDATE_DELAY 100
+//ms after which deferred startup goes on without a first paint
+#define FIRST_FRAME_TIMEOUT 500
+#define THEME_PATH QLatin1String(":/themes/")
+//seconds a hidden daemon waits before trimming its caches
+#define DEFAULT_IDLE_TRIM_DELAY 300
 
 #include "x11keyboard.h"
-
-void KvkbdApp::initGui(bool loginhelper)
+#include "x11connection.h"
+#include "kvkbdadaptor.h"
+#include "metrics.h"
+#include "metricsadaptor.h"
+#include "startuploader.h"
+#include "trace.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+void KvkbdApp::initGui(bool loginhelper, bool daemon)
 {
+    TRACE_SPAN("KvkbdApp::initGui");
+
     is_login = loginhelper;
+    is_daemon = daemon && !loginhelper;
     signalMapper = new QSignalMapper(this);
     connect(signalMapper, SIGNAL(mappedString(const QString &)), this, SLOT(buttonAction(const QString &)));
 
+    KConfigGroup cfg(KSharedConfig::openConfig(), QLatin1String("General"));
+
+    // Theme and colors are read on worker threads while the keyboard
+    // connects to the X server and the session bus below
+    QString themeName = cfg.readEntry("layout", "standard");
+    bool styleSheets = cfg.readEntry("styleSheets", QVariant(false)).toBool();
+    StartupLoader startup;
+    bool parallelStartup = cfg.readEntry("parallelStartup", QVariant(true)).toBool();
+    if (parallelStartup) {
+        startup.loadTheme(themeName, THEME_PATH);
+        if (!styleSheets) {
+            startup.loadColorStyle(ThemeLoader::selectedColorFile(cfg.readEntry("colors")), QGuiApplication::palette());
+        }
+    }
+
     widget = new ResizableDragWidget(nullptr);
     widget->setContentsMargins(10,10,10,10);
     widget->setProperty("name", QLatin1String("main"));
 
-    KConfigGroup cfg(KSharedConfig::openConfig(), QLatin1String("General"));
-
     if (!is_login) {
         widget->setAttribute(Qt::WA_ShowWithoutActivating);
         widget->setAttribute(Qt::WA_DeleteOnClose, false);
@@ -68,22 +103,228 @@ void KvkbdApp::initGui(bool loginhelper)
 
     widget->setWindowFlags(Qt::ToolTip | Qt::FramelessWindowHint | Qt::BypassWindowManagerHint);
 
-    dock = new KbdDock(widget->winId());
-    connect(dock, SIGNAL(requestVisibility()), widget, SLOT(toggleVisibility()));
-
-    tray = new KbdTray(widget);
-    connect(tray, SIGNAL(requestVisibility()), widget, SLOT(toggleVisibility()));
+    dockTimer = new QTimer(this);
+    dockTimer->setSingleShot(true);
+    dockTimer->setInterval(DOCK_UPDATE_DELAY);
+    connect(dockTimer, SIGNAL(timeout()), this, SLOT(updateDock()));
+    widget->installEventFilter(this);
 
     layout = new QGridLayout(widget);
     layout->setContentsMargins(0,0,0,0);
     widget->setLayout(layout);
 
     xkbd = new X11Keyboard(this);
+    xkbd->setKeyEventDelay(cfg.readEntry("keyEventDelay", 0));
+    connect(xkbd, SIGNAL(layoutUpdated(int,QString)), this, SLOT(scheduleDockUpdate()));
+    connect(xkbd, SIGNAL(groupStateChanged(const ModifierGroupStateMap&)), this, SLOT(scheduleDockUpdate()));
+    connect(xkbd, SIGNAL(modifiersReleased()), this, SLOT(modifiersReleased()));
+    connect(this, SIGNAL(textSwitch(bool)), this, SLOT(scheduleDockUpdate()));
+    connect(this, SIGNAL(fontUpdated(const QFont&)), this, SLOT(scheduleDockUpdate()));
 
     themeLoader = new ThemeLoader(widget);
+    themeLoader->setPaintedKeys(cfg.readEntry("paintedKeys", QVariant(false)).toBool());
+    themeLoader->setStyleSheets(styleSheets);
+    VButton::ServerRepeat = cfg.readEntry("serverRepeat", QVariant(false)).toBool();
     connect(themeLoader, SIGNAL(partLoaded(MainWidget*, int, int)), this, SLOT(partLoaded(MainWidget*, int, int)));
     connect(themeLoader, SIGNAL(buttonLoaded(VButton*)), this, SLOT(buttonLoaded(VButton*)));
 
+    widget->setProperty("autoresfont", cfg.readEntry("autoresfont",true));
+    widget->setProperty("stickyModKeys", cfg.readEntry("stickyModKeys", QVariant(false)).toBool());
+    xkbd->setStickyModifiers(widget->property("stickyModKeys").toBool());
+    widget->blurBackground(cfg.readEntry("blurBackground", QVariant(true)).toBool());
+
+    QFont font = cfg.readEntry("font", widget->font());
+    widget->setFont(font);
+
+    if (parallelStartup) {
+        startup.waitForDone();
+    }
+
+    if (startup.colorStyleLoaded()) {
+        themeLoader->applyColorStyle(startup.colorStyle(), startup.colorFile());
+    }
+    else {
+        themeLoader->loadSelectedColorStyle(cfg.readEntry("colors"));
+    }
+    connect(themeLoader, SIGNAL(colorStyleChanged()), widget, SLOT(repaint()));
+    connect(themeLoader, SIGNAL(colorStyleChanged()), this, SLOT(scheduleDockUpdate()));
+
+    // A hidden extension is only built by its first toggleExtension
+    // A daemon never paints at startup and has nothing to defer past it
+    deferredStartup = !is_daemon && cfg.readEntry("deferredStartup", QVariant(true)).toBool();
+    bool extensionVisible = cfg.readEntry("extentVisible", QVariant(true)).toBool();
+    if (deferredStartup && !extensionVisible) {
+        themeLoader->setDeferredParts(QStringList() << QLatin1String("extension"));
+    }
+
+    if (startup.themeStatus() == 0) {
+        themeLoader->buildLayout(startup.theme());
+    }
+    else {
+        // Not read yet, or failed: reports the error and falls back
+        themeLoader->loadTheme(themeName);
+    }
+    widget->setProperty("layout", themeName);
+
+    QSize defaultSize(DEFAULT_WIDTH,DEFAULT_HEIGHT);
+    QRect screenGeometry = QGuiApplication::primaryScreen()->availableGeometry();
+    qDebug() << "ScreenGeometry: " << screenGeometry;
+
+    QPoint bottomRight = screenGeometry.bottomRight()-QPoint(defaultSize.width(), defaultSize.height());
+
+    QRect widgetGeometry(bottomRight, defaultSize);
+    qDebug() << "widgetGeometry: " << widgetGeometry;
+
+    QRect c_geometry = cfg.readEntry("geometry", widgetGeometry);
+    if (!screenGeometry.contains(c_geometry, true)) {
+        c_geometry = widgetGeometry;
+    }
+    widget->setGeometry(c_geometry);
+
+    if (is_daemon) {
+        // Polish, lay out and paint once offscreen so the first show only
+        // has to map the window, then wait minimized for activate()
+        TRACE_SPAN("prewarm");
+        widget->winId();
+        layout->activate();
+        widget->grab();
+        widget->setWindowState(Qt::WindowMinimized);
+
+        idleTimer = new QTimer(this);
+        idleTimer->setSingleShot(true);
+        idleTimer->setInterval(cfg.readEntry("idleTrimDelay", DEFAULT_IDLE_TRIM_DELAY) * 1000);
+        connect(idleTimer, SIGNAL(timeout()), this, SLOT(trimCaches()));
+        if (idleTimer->interval() > 0) {
+            idleTimer->start();
+        }
+    }
+    else {
+        TRACE_SPAN("show");
+        widget->show();
+    }
+
+    if (!extensionVisible && parts.contains(QLatin1String("extension"))) {
+        toggleExtension();
+    }
+
+    setQuitOnLastWindowClosed (is_login);
+
+    connect(this, SIGNAL(aboutToQuit()), this, SLOT(storeConfig()));
+    Q_EMIT fontUpdated(widget->font());
+
+    xkbd->start();
+
+    if (!is_login) {
+        bool vis = cfg.readEntry("visible", QVariant(true)).toBool();
+        if (!vis && !is_daemon) {
+            widget->showMinimized();
+        }
+        widget->setWindowTitle(QLatin1String("kvkbd"));
+    } else {
+        QTimer *timer = new QTimer(this);
+        timer->setInterval(1000);
+        connect(timer, SIGNAL(timeout()), widget, SLOT(raise()));
+        timer->start();
+        widget->setWindowTitle(QLatin1String("kvkbd.login"));
+    }
+
+    if (deferredStartup) {
+        // Started from the first paint of the keyboard, or after a while if
+        // it starts hidden and never paints
+        QTimer::singleShot(FIRST_FRAME_TIMEOUT, this, SLOT(startDeferredTasks()));
+    }
+    else {
+        while (startupTask < StartupTaskCount) {
+            runStartupTask();
+        }
+    }
+}
+
+void KvkbdApp::startDeferredTasks()
+{
+    if (startupStarted) return;
+
+    startupStarted = true;
+    runStartupTask();
+}
+
+void KvkbdApp::runStartupTask()
+{
+    switch (startupTask) {
+    case DockTask:
+        initDock();
+        break;
+    case TrayTask:
+        initTray();
+        break;
+    case MenuTask:
+        initMenus();
+        break;
+    case BusTask:
+        initBus();
+        break;
+    default:
+        return;
+    }
+
+    startupTask++;
+    if (startupTask == StartupTaskCount) {
+        TRACE_INSTANT("startupCompleted");
+        Q_EMIT startupCompleted();
+#ifdef KVKBD_TRACING
+        Trace::write();
+#endif
+    }
+    else if (deferredStartup) {
+        // One task per pass of the event loop, input and paints go in between
+        QTimer::singleShot(0, this, SLOT(runStartupTask()));
+    }
+}
+
+void KvkbdApp::initDock()
+{
+    TRACE_SPAN("KvkbdApp::initDock");
+    KConfigGroup cfg(KSharedConfig::openConfig(), QLatin1String("General"));
+
+    dock = new KbdDock(widget->winId());
+    connect(dock, SIGNAL(requestVisibility()), widget, SLOT(toggleVisibility()));
+    dock->installEventFilter(this);
+    dock->blurBackground(widget->property("blurBackground").toBool());
+
+    QRect screenGeometry = QGuiApplication::primaryScreen()->availableGeometry();
+    QPoint pos = widget->geometry().topLeft();
+    pos.setY(pos.y()-dock->height());
+
+    QRect dockGeometry(pos, dock->size());
+
+    QRect c_dock_geometry = cfg.readEntry("dockGeometry", dockGeometry);
+    if (!screenGeometry.contains(c_dock_geometry, true)) {
+        c_dock_geometry = dockGeometry;
+    }
+    dock->setGeometry(c_dock_geometry);
+
+    bool dockVisible = cfg.readEntry("showdock", QVariant(false)).toBool();
+    if (dockVisible && !is_login) {
+        dock->show();
+    }
+}
+
+void KvkbdApp::initTray()
+{
+    TRACE_SPAN("KvkbdApp::initTray");
+    tray = new KbdTray(widget);
+    connect(tray, SIGNAL(requestVisibility()), widget, SLOT(toggleVisibility()));
+
+    if (!is_login) {
+        tray->show();
+    }
+}
+
+void KvkbdApp::initMenus()
+{
+    TRACE_SPAN("KvkbdApp::initMenus");
+    KConfigGroup cfg(KSharedConfig::openConfig(), QLatin1String("General"));
+
     QMenu *cmenu = tray->contextMenu();
 
     QAction *chooseFontAction = new QAction(QIcon::fromTheme(QLatin1String("preferences-desktop-font")), i18nc("@action:inmenu", "Choose Font..."), this);
@@ -91,27 +332,18 @@ void KvkbdApp::initGui(bool loginhelper)
     cmenu->addAction(chooseFontAction);
 
     KToggleAction *autoResizeAction = new KToggleAction(i18nc("@action:inmenu", "Auto Resize Font"), this);
-    bool autoResizeEnabled = cfg.readEntry("autoresfont",true);
-    autoResizeAction->setChecked(autoResizeEnabled);
-    widget->setProperty("autoresfont", autoResizeEnabled);
+    autoResizeAction->setChecked(widget->property("autoresfont").toBool());
     cmenu->addAction(autoResizeAction);
     connect(autoResizeAction,SIGNAL(triggered(bool)), this, SLOT(autoResizeFont(bool)));
 
-    bool blur = cfg.readEntry("blurBackground", QVariant(true)).toBool();
-
     KToggleAction *blurBackgroundAction = new KToggleAction(i18nc("@action:inmenu", "Blur Background"), this);
-    blurBackgroundAction->setChecked(blur);
+    blurBackgroundAction->setChecked(widget->property("blurBackground").toBool());
     cmenu->addAction(blurBackgroundAction);
-    widget->blurBackground(blur);
     connect(blurBackgroundAction,SIGNAL(triggered(bool)), widget, SLOT(blurBackground(bool)));
-    dock->blurBackground(blur);
     connect(blurBackgroundAction,SIGNAL(triggered(bool)), dock, SLOT(blurBackground(bool)));
-    widget->blurBackground(blur);
-    dock->blurBackground(blur);
 
-    bool dockVisible = cfg.readEntry("showdock", QVariant(false)).toBool();
     KToggleAction *showDockAction = new KToggleAction(i18nc("@action:inmenu", "Show Dock"), this);
-    showDockAction->setChecked(dockVisible);
+    showDockAction->setChecked(dock->isVisible());
     cmenu->addAction(showDockAction);
     connect(showDockAction,SIGNAL(triggered(bool)), dock, SLOT(setVisible(bool)));
 
@@ -121,22 +353,15 @@ void KvkbdApp::initGui(bool loginhelper)
     cmenu->addAction(lockOnScreenAction);
     connect(lockOnScreenAction,SIGNAL(triggered(bool)), widget, SLOT(setLocked(bool)));
 
-    bool stickyModKeys = cfg.readEntry("stickyModKeys", QVariant(false)).toBool();
     KToggleAction *stickyModKeysAction = new KToggleAction(i18nc("@action:inmenu", "Sticky Modifier Keys"), this);
-    stickyModKeysAction->setChecked(stickyModKeys);
+    stickyModKeysAction->setChecked(widget->property("stickyModKeys").toBool());
     cmenu->addAction(stickyModKeysAction);
     connect(stickyModKeysAction,SIGNAL(triggered(bool)), this, SLOT(setStickyModKeys(bool)));
-    widget->setProperty("stickyModKeys", stickyModKeys);
-
-    QFont font = cfg.readEntry("font", widget->font());
-    widget->setFont(font);
 
-    QString colorsFilename = cfg.readEntry("colors");
+    // The selected style is applied already, this only fills the menu
     QMenu *colors = new QMenu(widget);
-    themeLoader->findColorStyles(colors, colorsFilename);
+    themeLoader->findColorStyles(colors, widget->property("colors").toString());
     cmenu->addMenu(colors);
-    connect(themeLoader, SIGNAL(colorStyleChanged()), widget, SLOT(repaint()));
-    connect(themeLoader, SIGNAL(colorStyleChanged()), dock, SLOT(repaint()));
 
     KHelpMenu *helpMenu = new KHelpMenu(widget, KAboutData::applicationData());
     helpMenu->menu()->setIcon(QIcon::fromTheme(QLatin1String("help-about")));
@@ -145,86 +370,132 @@ void KvkbdApp::initGui(bool loginhelper)
     QAction *quit = new QAction(QIcon::fromTheme(QLatin1String("application-exit")), i18nc("@action:inmenu", "Quit"), this);
     cmenu->addAction(quit);
     connect(quit,SIGNAL(triggered(bool)), this, SLOT(quit()));
+}
 
-    QString themeName = cfg.readEntry("layout", "standard");
-    themeLoader->loadTheme(themeName);
-    widget->setProperty("layout", themeName);
-
-    QSize defaultSize(DEFAULT_WIDTH,DEFAULT_HEIGHT);
-    QRect screenGeometry = QGuiApplication::primaryScreen()->availableGeometry();
-    qDebug() << "ScreenGeometry: " << screenGeometry;
-
-    QPoint bottomRight = screenGeometry.bottomRight()-QPoint(defaultSize.width(), defaultSize.height());
+void KvkbdApp::initBus()
+{
+    TRACE_SPAN("KvkbdApp::initBus");
+    new KvkbdAdaptor(this);
+    Metrics *metrics = new Metrics(this);
+    new MetricsAdaptor(metrics);
+
+    QDBusConnection session = QDBusConnection::sessionBus();
+    if (!session.registerObject(QLatin1String("/Kvkbd"), this) || !session.registerObject(QLatin1String("/Metrics"), metrics)
+        || !session.registerService(QLatin1String("org.kde.kvkbd"))) {
+        qWarning() << "KvkbdApp: unable to export org.kde.kvkbd on the session bus";
+    }
+}
 
-    QRect widgetGeometry(bottomRight, defaultSize);
-    qDebug() << "widgetGeometry: " << widgetGeometry;
+bool KvkbdApp::isAlone() const
+{
+    return is_login;
+}
 
-    QRect c_geometry = cfg.readEntry("geometry", widgetGeometry);
-    if (!screenGeometry.contains(c_geometry, true)) {
-        c_geometry = widgetGeometry;
-    }
-    widget->setGeometry(c_geometry);
+bool KvkbdApp::isVisible() const
+{
+    return widget->isVisible();
+}
 
-    QPoint pos = c_geometry.topLeft();
-    pos.setY(pos.y()-dock->height());
+qulonglong KvkbdApp::injectedEvents() const
+{
+    return xkbd ? xkbd->injectedEvents() : 0;
+}
 
-    QRect dockGeometry(pos, dock->size());
+qulonglong KvkbdApp::openConnections() const
+{
+    return X11Connection::openCount();
+}
 
-    QRect c_dock_geometry = cfg.readEntry("dockGeometry", dockGeometry);
-    if (!screenGeometry.contains(c_dock_geometry, true)) {
-        c_dock_geometry = dockGeometry;
+void KvkbdApp::setVisible(bool visible)
+{
+    if (visible != widget->isVisible()) {
+        if (visible) beginShow();
+        widget->toggleVisibility();
     }
-    dock->setGeometry(c_dock_geometry);
+}
 
-    widget->show();
+void KvkbdApp::activate()
+{
+    if (!widget->isVisible() || widget->isMinimized()) {
+        beginShow();
+        widget->toggleVisibility();
+    }
+    else {
+        widget->raise();
+        widget->activateWindow();
+    }
+}
 
-    bool extensionVisible = cfg.readEntry("extentVisible", QVariant(true)).toBool();
-    if (!extensionVisible) {
-        toggleExtension();
+void KvkbdApp::show(int x, int y)
+{
+    if (x >= 0 && y >= 0) {
+        widget->move(x, y);
     }
+    activate();
+}
 
-    setQuitOnLastWindowClosed (is_login);
+void KvkbdApp::beginShow()
+{
+    if (!showTimer.isValid()) {
+        showTimer.start();
+    }
+}
 
-    connect(this, SIGNAL(aboutToQuit()), this, SLOT(storeConfig()));
-    Q_EMIT fontUpdated(widget->font());
+void KvkbdApp::trimCaches()
+{
+    if (widget->isVisible() && !widget->isMinimized()) return;
 
-    if (dockVisible && !is_login) {
-        dock->show();
+    for (MainWidget *part : std::as_const(parts)) {
+        part->trimCaches();
     }
+    QPixmapCache::clear();
+#ifdef __GLIBC__
+    // Hand the freed heap back to the system
+    malloc_trim(0);
+#endif
+}
 
-    xkbd->start();
+bool KvkbdApp::isLocked() const
+{
+    return widget->isLocked();
+}
 
-    if (!is_login) {
-        bool vis = cfg.readEntry("visible", QVariant(true)).toBool();
-        if (!vis ) {
-            widget->showMinimized();
-        }
-        widget->setWindowTitle(QLatin1String("kvkbd"));
-        tray->show();
-    } else {
-        QTimer *timer = new QTimer(this);
-        timer->setInterval(1000);
-        connect(timer, SIGNAL(timeout()), widget, SLOT(raise()));
-        timer->start();
-        widget->setWindowTitle(QLatin1String("kvkbd.login"));
-    }
+void KvkbdApp::setLocked(bool locked)
+{
+    widget->setLocked(locked);
+}
+
+int KvkbdApp::typeText(const QString& text)
+{
+    return xkbd->typeText(text);
 }
 
 KvkbdApp::~KvkbdApp()
 {
+    // Releases held keys, latches and scratch keys on the shared display,
+    // which must still be open
+    delete xkbd;
+    xkbd = nullptr;
+
+    X11Connection::release();
 }
 
 void KvkbdApp::storeConfig()
 {
     KConfigGroup cfg(KSharedConfig::openConfig(), QLatin1String("General"));
 
-    cfg.writeEntry("visible", widget->isVisible());
+    if (!is_daemon) {
+        //a daemon is hidden by design, not by the user
+        cfg.writeEntry("visible", widget->isVisible());
+    }
     cfg.writeEntry("geometry", widget->geometry());
     cfg.writeEntry("locked", widget->isLocked());
     cfg.writeEntry("stickyModKeys", widget->property("stickyModKeys"));
 
-    cfg.writeEntry("showdock", dock->isVisible());
-    cfg.writeEntry("dockGeometry", dock->geometry());
+    if (dock) {
+        cfg.writeEntry("showdock", dock->isVisible());
+        cfg.writeEntry("dockGeometry", dock->geometry());
+    }
 
     cfg.writeEntry("layout", widget->property("layout"));
     cfg.writeEntry("colors", widget->property("colors"));
@@ -249,6 +520,7 @@ void KvkbdApp::autoResizeFont(bool mode)
 void KvkbdApp::setStickyModKeys(bool mode)
 {
     widget->setProperty("stickyModKeys", QVariant(mode));
+    xkbd->setStickyModifiers(mode);
 }
 
 void KvkbdApp::chooseFont()
@@ -278,9 +550,12 @@ void KvkbdApp::buttonLoaded(VButton *btn)
 {
     if (btn->property("modifier").toBool() == true) {
         modKeys.append(btn);
+        connect(btn, SIGNAL(toggled(bool)), this, SLOT(modifiersChanged()));
     }
     else {
         QObject::connect(btn, SIGNAL(keyClick(unsigned int)), xkbd, SLOT(processKeyPress(unsigned int)) );
+        QObject::connect(btn, SIGNAL(keyDown(unsigned int)), xkbd, SLOT(processKeyDown(unsigned int)) );
+        QObject::connect(btn, SIGNAL(keyUp(unsigned int)), xkbd, SLOT(processKeyUp(unsigned int)) );
     }
     QString bAction = btn->property("action").toString();
 
@@ -316,15 +591,24 @@ void KvkbdApp::partLoaded(MainWidget *vPart, int total_rows, int total_cols)
 
     QObject::connect(xkbd, SIGNAL(layoutUpdated(int,QString)), vPart, SLOT(updateLayout(int,QString)));
     QObject::connect(xkbd, SIGNAL(groupStateChanged(const ModifierGroupStateMap&)), vPart, SLOT(updateGroupState(const ModifierGroupStateMap&)));
-    QObject::connect(xkbd, SIGNAL(keyProcessComplete(unsigned int)), this, SLOT(keyProcessComplete(unsigned int)));
 
     QObject::connect(this, SIGNAL(textSwitch(bool)), vPart, SLOT(textSwitch(bool)));
     QObject::connect(this, SIGNAL(fontUpdated(const QFont&)), vPart, SLOT(updateFont(const QFont&)));
+
+    if (qobject_cast<KeyboardSurface*>(vPart)) {
+        QObject::connect(vPart, SIGNAL(keyClick(unsigned int)), xkbd, SLOT(processKeyPress(unsigned int)));
+        QObject::connect(vPart, SIGNAL(keyDown(unsigned int)), xkbd, SLOT(processKeyDown(unsigned int)));
+        QObject::connect(vPart, SIGNAL(keyUp(unsigned int)), xkbd, SLOT(processKeyUp(unsigned int)));
+        QObject::connect(vPart, SIGNAL(buttonAction(const QString&)), this, SLOT(buttonAction(const QString&)));
+        QObject::connect(vPart, SIGNAL(modifierToggled(unsigned int, bool)), this, SLOT(modifiersChanged()));
+    }
 }
 
-void KvkbdApp::keyProcessComplete(unsigned int)
+void KvkbdApp::modifiersReleased()
 {
-    if (widget->property("stickyModKeys").toBool()) return;
+    // xkbd has queued the release with the key already, only the buttons
+    // are left to uncheck
+    releasingModifiers = true;
 
     QListIterator<VButton *> itr(modKeys);
     while (itr.hasNext()) {
@@ -333,6 +617,88 @@ void KvkbdApp::keyProcessComplete(unsigned int)
             mod->click();
         }
     }
+
+    for (MainWidget *part : std::as_const(parts)) {
+        if (KeyboardSurface *surface = qobject_cast<KeyboardSurface*>(part)) {
+            surface->releaseModifiers();
+        }
+    }
+
+    releasingModifiers = false;
+    scheduleDockUpdate();
+}
+
+void KvkbdApp::modifiersChanged()
+{
+    if (releasingModifiers) return;
+
+    QList<unsigned int> keyCodes;
+
+    QListIterator<VButton *> itr(modKeys);
+    while (itr.hasNext()) {
+        VButton *mod = itr.next();
+        if (mod->isChecked()) {
+            keyCodes << mod->getKeyCode();
+        }
+    }
+
+    for (MainWidget *part : std::as_const(parts)) {
+        if (KeyboardSurface *surface = qobject_cast<KeyboardSurface*>(part)) {
+            keyCodes << surface->checkedModifiers();
+        }
+    }
+
+    xkbd->setLatchedModifiers(keyCodes);
+    scheduleDockUpdate();
+}
+
+void KvkbdApp::scheduleDockUpdate()
+{
+    dockDirty = true;
+    if (dock && dock->isVisible() && !dockTimer->isActive()) {
+        dockTimer->start();
+    }
+}
+
+void KvkbdApp::updateDock()
+{
+    if (!dock || !dock->isVisible()) return;
+
+    //renders the widget tree directly, no screenshot of the window
+    dockDirty = false;
+    dock->setPixmap(widget->grab());
+}
+
+bool KvkbdApp::eventFilter(QObject *object, QEvent *event)
+{
+    if (object == widget && event->type() == QEvent::Paint && !firstFrame) {
+        firstFrame = true;
+        TRACE_INSTANT("firstFrame");
+        if (deferredStartup) {
+            QTimer::singleShot(0, this, SLOT(startDeferredTasks()));
+        }
+    }
+
+    if (object == widget && event->type() == QEvent::Show) {
+        beginShow();
+        if (idleTimer) idleTimer->stop();
+    }
+    else if (object == widget && event->type() == QEvent::Hide && idleTimer && idleTimer->interval() > 0) {
+        idleTimer->start();
+    }
+    else if (object == widget && event->type() == QEvent::Paint && showTimer.isValid()) {
+        Metrics::record(Metrics::Show, showTimer.nsecsElapsed());
+        showTimer.invalidate();
+    }
+
+    if (object == widget && (event->type() == QEvent::Resize || event->type() == QEvent::Show)) {
+        scheduleDockUpdate();
+    }
+    else if (object == dock && event->type() == QEvent::Show && dockDirty) {
+        scheduleDockUpdate();
+    }
+
+    return QApplication::eventFilter(object, event);
 }
 
 void KvkbdApp::buttonAction(const QString &action)
@@ -344,22 +710,37 @@ void KvkbdApp::buttonAction(const QString &action)
     } else if (QString::compare(action, QLatin1String("toggleExtension"))==0) {
         toggleExtension();
     } else if (QString::compare(action, QLatin1String("shiftText"))==0) {
-        if (actionButtons.contains(action)) {
-            QList<VButton*> buttons = actionButtons.values(action);
-            QListIterator<VButton *> itr(buttons);
-            bool setShift = false;
-            while (itr.hasNext()) {
-                VButton *btn = itr.next();
-                if (btn->isCheckable() && btn->isChecked()) setShift=true;
-            }
-            Q_EMIT textSwitch(setShift);
+        QList<VButton*> buttons = actionButtons.values(action);
+        QListIterator<VButton *> itr(buttons);
+        bool setShift = false;
+        while (itr.hasNext()) {
+            VButton *btn = itr.next();
+            if (btn->isCheckable() && btn->isChecked()) setShift=true;
+        }
+        for (MainWidget *part : std::as_const(parts)) {
+            KeyboardSurface *surface = qobject_cast<KeyboardSurface*>(part);
+            if (surface && surface->isActionChecked(action)) setShift=true;
         }
+        Q_EMIT textSwitch(setShift);
     }
 }
 
 void KvkbdApp::toggleExtension()
 {
     MainWidget *prt = parts.value(QLatin1String("extension"));
+    if (!prt) {
+        // Built on first use, partLoaded places it in the layout
+        prt = themeLoader->loadPart(QLatin1String("extension"));
+        if (!prt) return;
+
+        //built after fontUpdated was emitted
+        prt->updateFont(widget->font());
+        prt->show();
+        xkbd->resendState();
+        scheduleDockUpdate();
+        return;
+    }
+
     if (prt->isVisible()) {
         prt->hide();
         layout->removeWidget(prt);
@@ -369,4 +750,5 @@ void KvkbdApp::toggleExtension()
         layout->addWidget(prt,span.y(),span.x(), span.height(), span.width());
         prt->show();
     }
+    scheduleDockUpdate();
 }
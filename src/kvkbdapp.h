@@ -26,9 +26,12 @@
 #include <QGridLayout>
 #include <QDomNode>
 #include <QDomNamedNodeMap>
+#include <QElapsedTimer>
+#include <QTimer>
 
 #include "resizabledragwidget.h"
 #include "mainwidget.h"
+#include "keyboardsurface.h"
 #include "kbdtray.h"
 #include "vbutton.h"
 #include "themeloader.h"
@@ -38,28 +41,109 @@
 class KvkbdApp : public QApplication
 {
     Q_OBJECT
+    Q_PROPERTY(bool alone READ isAlone)
+    Q_PROPERTY(bool visible READ isVisible WRITE setVisible)
+    Q_PROPERTY(bool locked READ isLocked WRITE setLocked)
+    Q_PROPERTY(qulonglong injectedEvents READ injectedEvents)
+    Q_PROPERTY(qulonglong openConnections READ openConnections)
 
 public:
     using QApplication::QApplication;
     ~KvkbdApp();
 
-    void initGui(bool loginhelper = false);
+    /**
+     * @param daemon build everything up front and stay hidden until asked
+     * to show, for instant show on demand
+     */
+    void initGui(bool loginhelper = false, bool daemon = false);
+
+    //running as the login screen helper
+    bool isAlone() const;
+    bool isVisible() const;
+    void setVisible(bool visible);
+    bool isLocked() const;
+    void setLocked(bool locked);
+    //key events sent so far, typed text included
+    qulonglong injectedEvents() const;
+    //X server connections opened since startup, flat while keys are sent
+    qulonglong openConnections() const;
 
 public Q_SLOTS:
-    void keyProcessComplete(unsigned int);
+    void modifiersReleased();
+    void modifiersChanged();
 
     void buttonAction(const QString& action);
     void storeConfig();
     void toggleExtension();
 
+    /**
+     * Shows and raises the keyboard, on request of a second launch.
+     */
+    void activate();
+
+    /**
+     * Moves the keyboard to @p x, @p y and activates it, exported over
+     * D-Bus as org.kde.kvkbd.Kvkbd.show. Negative coordinates keep the
+     * current position.
+     */
+    void show(int x, int y);
+
+    /**
+     * Drops the caches rebuilt on the next paint, run while a daemon has
+     * been hidden for the configured idle period.
+     */
+    void trimCaches();
+
     void chooseFont();
     void autoResizeFont(bool mode);
     void setStickyModKeys(bool mode);
 
+    /**
+     * Types @p text with the current keyboard layout, exported over D-Bus
+     * as org.kde.kvkbd.Kvkbd.typeText.
+     *
+     * @return the number of characters typed
+     */
+    int typeText(const QString& text);
+
     void partLoaded(MainWidget *vPart, int total_rows, int total_cols);
     void buttonLoaded(VButton *btn);
 
+    /**
+     * Marks the dock picture stale, it is rendered again shortly after
+     * if the dock is visible or else when it is shown.
+     */
+    void scheduleDockUpdate();
+    void updateDock();
+
+protected Q_SLOTS:
+    void startDeferredTasks();
+    void runStartupTask();
+
 protected:
+    enum StartupTask {
+        DockTask,
+        TrayTask,
+        MenuTask,
+        BusTask,
+        StartupTaskCount
+    };
+
+    /**
+     * Parts of the interface not needed for the first frame. In deferred
+     * startup they are built one per event loop pass once the keyboard
+     * has painted, otherwise at the end of initGui.
+     */
+    void initDock();
+    void initTray();
+    void initMenus();
+    void initBus();
+
+    bool eventFilter(QObject *object, QEvent *event) override;
+
+    //times the next show of the keyboard until it has painted
+    void beginShow();
+
     QMap<QString, QString> colorMap;
     QMap<QString, MainWidget*> parts;
     QMap<QString, QRect> layoutPosition;
@@ -71,7 +155,18 @@ protected:
     QGridLayout *layout = nullptr;
     ThemeLoader *themeLoader = nullptr;
     ResizableDragWidget *widget = nullptr;
+    QTimer *dockTimer = nullptr;
+    bool dockDirty = true;
+    int startupTask = DockTask;
+    bool deferredStartup = false;
+    bool startupStarted = false;
+    bool firstFrame = false;
     bool is_login = false;
+    bool is_daemon = false;
+    //unchecking the modifier keys after xkbd released them
+    bool releasingModifiers = false;
+    QTimer *idleTimer = nullptr;
+    QElapsedTimer showTimer;
 
 Q_SIGNALS:
     void textSwitch(bool);
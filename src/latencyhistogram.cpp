@@ -0,0 +1,99 @@
+// Class LatencyHistogram: lock-free log-linear latency histogram
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "latencyhistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+int LatencyHistogram::bucketIndex(qint64 ns)
+{
+    quint64 value = (quint64)qBound<qint64>(0, ns, (Q_INT64_C(1) << MAX_BITS) - 1);
+    if (value < SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63;
+    while (!(value & (Q_UINT64_C(1) << msb))) {
+        msb--;
+    }
+    int shift = msb - SUB_BITS;
+    int sub = (int)(value >> shift) & (SUB_BUCKETS - 1);
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+qint64 LatencyHistogram::bucketValue(int index)
+{
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+
+    int shift = index / SUB_BUCKETS - 1;
+    int sub = index % SUB_BUCKETS;
+    qint64 low = (qint64)(SUB_BUCKETS + sub) << shift;
+    return low + (Q_INT64_C(1) << shift) / 2;
+}
+
+void LatencyHistogram::record(qint64 ns)
+{
+    buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(ns, std::memory_order_relaxed);
+
+    qint64 seen = maxNs.load(std::memory_order_relaxed);
+    while (ns > seen && !maxNs.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+    }
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::max() const
+{
+    return maxNs.load(std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::mean() const
+{
+    quint64 n = count();
+    return n > 0 ? sumNs.load(std::memory_order_relaxed) / (qint64)n : 0;
+}
+
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    // Sum the buckets rather than trust total, record() may be halfway
+    quint64 counts[BUCKET_COUNT];
+    quint64 n = 0;
+    for (int a = 0; a < BUCKET_COUNT; a++) {
+        counts[a] = buckets[a].load(std::memory_order_relaxed);
+        n += counts[a];
+    }
+    if (n == 0) return 0;
+
+    quint64 rank = (quint64)(qBound(0.0, percent, 100.0) / 100.0 * n + 0.5);
+    rank = qBound<quint64>(1, rank, n);
+
+    quint64 seen = 0;
+    for (int a = 0; a < BUCKET_COUNT; a++) {
+        seen += counts[a];
+        if (seen >= rank) {
+            return qMin(bucketValue(a), max());
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::reset()
+{
+    for (int a = 0; a < BUCKET_COUNT; a++) {
+        buckets[a].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sumNs.store(0, std::memory_order_relaxed);
+    maxNs.store(0, std::memory_order_relaxed);
+}
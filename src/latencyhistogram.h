@@ -0,0 +1,56 @@
+// Class LatencyHistogram: lock-free log-linear latency histogram
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+/**
+ * Class LatencyHistogram:
+ * Durations in ns counted in fixed buckets, eight per power of two, so a
+ * percentile is off by at most 1/16 of its value. record() is a handful
+ * of relaxed atomic operations and may be called from any thread; the
+ * readers see a slightly stale but consistent enough picture.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 ns);
+
+    quint64 count() const;
+    qint64 max() const;
+    qint64 mean() const;
+
+    /**
+     * @return the duration @p percent of the recorded ones do not exceed,
+     * the middle of its bucket, 0 if nothing was recorded
+     */
+    qint64 percentile(double percent) const;
+
+    void reset();
+
+protected:
+    enum {
+        SUB_BUCKETS = 8,
+        SUB_BITS = 3,
+        //durations up to 2^40 ns, about 18 minutes
+        MAX_BITS = 40,
+        BUCKET_COUNT = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS
+    };
+
+    static int bucketIndex(qint64 ns);
+    static qint64 bucketValue(int index);
+
+    std::atomic<quint64> buckets[BUCKET_COUNT];
+    std::atomic<quint64> total;
+    std::atomic<qint64> sumNs;
+    std::atomic<qint64> maxNs;
+};
+
+#endif // LATENCYHISTOGRAM_H
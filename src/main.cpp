@@ -21,6 +21,8 @@
  */
 
 #include "kvkbdapp.h"
+#include "singleinstance.h"
+#include "trace.h"
 #include <KAboutData>
 #include <KLocalizedString>
 
@@ -29,44 +31,17 @@
 
 static QString version = QLatin1String("0.8.1");
 
-#include <X11/Xlib.h>
-
-void findLoginWindow()
-{
-	unsigned int numkids, i, scrn;
-	Window r, p;
-	Window *kids = nullptr;
-	Window root;
-	Display *dipsy = nullptr;
-	char *win_name = nullptr;
-
-	dipsy = XOpenDisplay(nullptr);
-	if (!dipsy) return;
-
-	scrn = DefaultScreen(dipsy);
-	root = RootWindow(dipsy, scrn);
-
-	XQueryTree(dipsy, root, &r, &p, &kids, &numkids);
-
-	for (i = 0; i < numkids;  ++i)
-	{
-        XFetchName(dipsy, kids[i], &win_name);
-        QString c(QString::fromLatin1(win_name));
-
-        if (c == QLatin1String("kvkbd.login")) {
-            long wid = kids[i];
-            XDestroyWindow(dipsy,wid);
-            XFlush(dipsy);
-            i=numkids;
-        }
-        XFree(win_name);
-	}
-	XCloseDisplay(dipsy);
-}
-
 int main(int argc, char **argv)
 {
+#ifdef KVKBD_TRACING
+    if (!qEnvironmentVariableIsEmpty("KVKBD_TRACE")) {
+        Trace::start(QString::fromLocal8Bit(qgetenv("KVKBD_TRACE")));
+    }
+#endif
+    TRACE_INSTANT("main");
+
     KvkbdApp app(argc, argv);
+    TRACE_INSTANT("application");
 
     KLocalizedString::setApplicationDomain("kvkbd");
     KAboutData about(QLatin1String("kvkbd"), i18n("Kvkbd"), version, QLatin1String("A virtual keyboard for KDE"),
@@ -85,14 +60,38 @@ int main(int argc, char **argv)
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addOption(loginhelper);
+    QCommandLineOption daemon(QLatin1String("daemon"), i18n("Start fully initialized but hidden and stay resident,\n"
+                                "shown by a new launch or over D-Bus."));
+    parser.addOption(daemon);
+#ifdef KVKBD_TRACING
+    QCommandLineOption traceOption(QLatin1String("trace"), i18n("Write a startup timeline in Chrome trace format to <file>."), QLatin1String("file"));
+    parser.addOption(traceOption);
+#endif
     parser.process(app);
 
+#ifdef KVKBD_TRACING
+    if (parser.isSet(traceOption) && !Trace::isEnabled()) {
+        Trace::start(parser.value(traceOption));
+    }
+#endif
+
     bool is_login = parser.isSet(loginhelper);
+    SingleInstance instance(is_login ? SingleInstance::LoginHelper : SingleInstance::Keyboard);
     if (!is_login) {
-        findLoginWindow();
+        // The session has started, the login screen helper is no longer needed
+        instance.sendCommand(SingleInstance::LoginHelper, SingleInstance::Quit);
+    }
+    if (!instance.acquire()) {
+        return 0;
     }
 
-    app.initGui(is_login);
+    app.initGui(is_login, parser.isSet(daemon));
+    QObject::connect(&instance, SIGNAL(activateRequested()), &app, SLOT(activate()));
+    QObject::connect(&instance, SIGNAL(quitRequested()), &app, SLOT(quit()));
 
-    return app.exec();
+    int ret = app.exec();
+#ifdef KVKBD_TRACING
+    Trace::write();
+#endif
+    return ret;
 }
@@ -1,4 +1,6 @@
 #include "mainwidget.h"
+#include "colorstyle.h"
+#include "trace.h"
 #include "vbutton.h"
 
 MainWidget::MainWidget(QWidget *parent) : QWidget(parent)
@@ -9,112 +11,157 @@ void MainWidget::setBaseSize(int w, int h)
 {
     bsize.setWidth(w);
     bsize.setHeight(h);
+}
+
+void MainWidget::addButton(VButton *btn, const KeyDescriptor& key)
+{
+    keyButtons << btn;
+    baseRects << key.rect;
+
+    if (key.groupToggle.length()>0 && key.groupLabel.length()>0 && key.label.length()>0) {
+        ToggleKey toggle;
+        toggle.button = btn;
+        toggle.label = key.label;
+        toggle.groupLabel = key.groupLabel;
+        toggleKeys[key.groupToggle] << toggle;
+    }
+
+    if (key.groupName.length()>0) {
+        groupKeys[key.groupName] << btn;
+    }
 
+    if (key.label.length()<1) {
+        textKeys << btn;
+    }
+
+    if (key.name == QLatin1String("currentLayout")) {
+        layoutKeys << btn;
+    }
 }
+
 void MainWidget::updateGroupState(const ModifierGroupStateMap& stateMap)
 {
-    QObjectList buttons = this->children();
     ModifierGroupStateMapIterator itr(stateMap);
-    QList<QChar> text;
 
     while (itr.hasNext()) {
         itr.next();
-        QString group_name = itr.key();
+        const QString &group_name = itr.key();
         bool state = itr.value();
 
-        for (int a=0; a<buttons.count(); a++) {
-
-            VButton *btn = (VButton*)buttons.at(a);
-
-            QString group_toggle = btn->property("group_toggle").toString();
-            QString btn_group_name = btn->property("group_name").toString();
-            QString group_label = btn->property("group_label").toString();
-            QString label = btn->property("label").toString();
+        auto last = groupState.constFind(group_name);
+        if (last != groupState.constEnd() && last.value() == state) {
+            continue;
+        }
+        groupState.insert(group_name, state);
 
-            if (QString::compare(group_toggle,group_name)==0) {
+        for (const ToggleKey &toggle : toggleKeys.value(group_name)) {
+            toggle.button->setText(state ? toggle.groupLabel : toggle.label);
+        }
 
-                if (group_label.length()>0 && label.length()>0) {
-                    if (state) {
-                        btn->setText(group_label);
-                    }
-                    else {
-                        btn->setText(label);
-                    }
-                }
-            }
-            else if (QString::compare(group_name, QLatin1String("capslock"))==0) {
+        if (group_name == QLatin1String("capslock")) {
+            for (VButton *btn : std::as_const(textKeys)) {
                 btn->setCaps(state);
                 btn->updateText();
             }
+        }
 
-            if (QString::compare(btn_group_name, group_name)==0) {
-                btn->setChecked(state);
-            }
+        for (VButton *btn : groupKeys.value(group_name)) {
+            btn->setChecked(state);
         }
     }
 }
 
 void MainWidget::textSwitch(bool setShift)
 {
-    QObjectList buttons = this->children();
-
-    for (int a=0; a<buttons.count(); a++) {
-        VButton *btn = (VButton*)buttons.at(a);
+    for (VButton *btn : std::as_const(textKeys)) {
         btn->setShift(setShift);
         btn->updateText();
     }
-
 }
+
 void MainWidget::updateLayout(int, const QString& layout_name)
 {
-    QObjectList buttons = this->children();
-
+    TRACE_SPAN("MainWidget::updateLayout");
     VKeyboard *vkbd = (VKeyboard*)QObject::sender();
 
-    for (int a=0; a<buttons.count(); a++) {
-
-        VButton *btn = (VButton*)buttons.at(a);
-
-        if (btn->property("label").toString().length()<1) {
-            ButtonText text;
-            vkbd->textForKeyCode(btn->getKeyCode(), text);
-            btn->setButtonText(text);
-            btn->updateText();
-        }
+    for (VButton *btn : std::as_const(textKeys)) {
+        ButtonText text;
+        vkbd->textForKeyCode(btn->getKeyCode(), text);
+        btn->setButtonText(text);
+        btn->updateText();
+    }
 
-        if (btn->objectName()==QLatin1String("currentLayout")) {
-            btn->setText(layout_name);
-        }
+    for (VButton *btn : std::as_const(layoutKeys)) {
+        btn->setText(layout_name);
     }
 }
 
 
 void MainWidget::resizeEvent(QResizeEvent *ev)
 {
-    const QSize& size = ev->size();
+    const QVector<QRect> rects = keyRects(ev->size());
 
-    double dw = (double)size.width() / (double)bsize.width();
-    double dh = (double)size.height() / (double)bsize.height();
+    for (int a=0; a<keyButtons.count(); a++) {
+        keyButtons.at(a)->setGeometry(rects.at(a));
+    }
+
+    //otherwise the font does not depend on the size, fontUpdated sets it
+    if (fontFollowsSize()) {
+        updateFont(this->parentWidget()->font());
+    }
+}
 
-    QObjectList buttons = this->children();
-    for (int a=0; a<buttons.count(); a++) {
+void MainWidget::trimCaches()
+{
+}
 
-        VButton *btn = (VButton*)buttons.at(a);
-        const QRect& geom = btn->VRect();
+QVector<QRect> MainWidget::keyRects(const QSize& size) const
+{
+    double dw = bsize.width() > 0 ? (double)size.width() / (double)bsize.width() : 1.0;
+    double dh = bsize.height() > 0 ? (double)size.height() / (double)bsize.height() : 1.0;
 
-        btn->setGeometry((geom.x() * dw), (geom.y() * dh), (geom.width() * dw), (geom.height() * dh));
+    QVector<QRect> rects;
+    rects.reserve(baseRects.count());
+    for (const QRect &geom : std::as_const(baseRects)) {
+        rects << QRect(geom.x() * dw, geom.y() * dh, geom.width() * dw, geom.height() * dh);
     }
+    return rects;
+}
 
-    updateFont(this->parentWidget()->font());
+bool MainWidget::fontFollowsSize() const
+{
+    return parentWidget()->property("autoresfont").toBool();
 }
 
-void MainWidget::updateFont(const QFont& widgetFont)
+QFont MainWidget::buttonFont(const QFont& widgetFont) const
 {
     int fontSize = widgetFont.pointSize();
-    if ( parentWidget()->property("autoresfont").toBool() ) {
+    if (fontSize < 1) {
+        fontSize = widgetFont.pixelSize();
+    }
+    if (fontFollowsSize()) {
         fontSize = (8.0 / 500.0) * this->parentWidget()->size().width();
     }
-    QString buttonStyle = QLatin1String("VButton { font-family:'%1'; font-size: %2px; font-weight:%3; font-style: %4; }").arg(widgetFont.family()).arg(fontSize).arg(widgetFont.bold() ? QLatin1String("bold") : QLatin1String("normal")).arg(widgetFont.italic() ? QLatin1String("italic") : QLatin1String("normal"));
-    this->setStyleSheet(buttonStyle);
 
+    QFont font = widgetFont;
+    font.setPixelSize(qMax(1, fontSize));
+    return font;
+}
+
+void MainWidget::updateFont(const QFont& widgetFont)
+{
+    QFont font = buttonFont(widgetFont);
+
+    if (ColorStyle::active()) {
+        //keys are painted from the compiled style, the font is all they need
+        if (!testAttribute(Qt::WA_SetFont) || this->font() != font) {
+            setFont(font);
+        }
+        return;
+    }
+
+    QString buttonStyle = QLatin1String("VButton { font-family:'%1'; font-size: %2px; font-weight:%3; font-style: %4; }").arg(font.family()).arg(font.pixelSize()).arg(font.bold() ? QLatin1String("bold") : QLatin1String("normal")).arg(font.italic() ? QLatin1String("italic") : QLatin1String("normal"));
+    if (buttonStyle != styleSheet()) {
+        this->setStyleSheet(buttonStyle);
+    }
 }
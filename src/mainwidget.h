@@ -9,9 +9,15 @@
 #include <QFont>
 #include <QSize>
 #include <QResizeEvent>
+#include <QHash>
+#include <QVector>
+#include <QRect>
 
+#include "keydescriptor.h"
 #include "vkeyboard.h"
 
+class VButton;
+
 
 class MainWidget : public QWidget
 {
@@ -21,15 +27,54 @@ public:
     explicit MainWidget(QWidget *parent = nullptr);
     void setBaseSize(int w, int h);
 
+    /**
+     * Adds a button created from @p key to the part and to the indexes
+     * state changes are dispatched through.
+     */
+    void addButton(VButton *btn, const KeyDescriptor& key);
+
+    /**
+     * Drops what is cached for painting, it is rebuilt when needed.
+     */
+    virtual void trimCaches();
+
 public Q_SLOTS:
-    void textSwitch(bool);
-    void updateLayout(int, const QString&);
-    void updateGroupState(const ModifierGroupStateMap&);
-    void updateFont(const QFont&);
+    virtual void textSwitch(bool);
+    virtual void updateLayout(int, const QString&);
+    virtual void updateGroupState(const ModifierGroupStateMap&);
+    virtual void updateFont(const QFont&);
 
 protected:
     void resizeEvent(QResizeEvent *ev) override;
+
+    /**
+     * @return the geometry of every key scaled to a part of @p size, in
+     * the order of baseRects
+     */
+    QVector<QRect> keyRects(const QSize& size) const;
+    QFont buttonFont(const QFont& widgetFont) const;
+    //the auto resized font, which follows the keyboard width
+    bool fontFollowsSize() const;
+
+    struct ToggleKey {
+        VButton *button;
+        QString label;
+        QString groupLabel;
+    };
+
     QSize bsize;
+    QVector<VButton*> keyButtons;
+    //key geometry in theme units
+    QVector<QRect> baseRects;
+
+    //keys relabeled by a group toggle, by toggle name
+    QHash<QString, QVector<ToggleKey>> toggleKeys;
+    //keys checked while a group is active, by group name
+    QHash<QString, QVector<VButton*>> groupKeys;
+    //unlabeled keys, their text comes from the keyboard layout
+    QVector<VButton*> textKeys;
+    QVector<VButton*> layoutKeys;
+    ModifierGroupStateMap groupState;
 };
 
 #endif // MAINWIDGET_H
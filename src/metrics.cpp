@@ -0,0 +1,91 @@
+// Class Metrics: always-on key tap latency histograms
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "metrics.h"
+#include "keyinjector.h"
+
+#include <QDebug>
+
+static const char *const stageNames[Metrics::StageCount] = {"input", "dispatch", "inject", "total", "show"};
+
+LatencyHistogram Metrics::s_histograms[Metrics::StageCount];
+qint64 Metrics::s_inputAt = 0;
+qint64 Metrics::s_emittedAt = 0;
+
+Metrics::Metrics(QObject *parent) : QObject(parent)
+{
+}
+
+void Metrics::record(Stage stage, qint64 ns)
+{
+    s_histograms[stage].record(ns);
+}
+
+const LatencyHistogram &Metrics::histogram(Stage stage)
+{
+    return s_histograms[stage];
+}
+
+void Metrics::inputStarted()
+{
+    s_inputAt = KeyInjector::now();
+    s_emittedAt = 0;
+}
+
+void Metrics::keyEmitted()
+{
+    if (s_inputAt == 0 || s_emittedAt != 0) return;
+
+    s_emittedAt = KeyInjector::now();
+    record(Input, s_emittedAt - s_inputAt);
+}
+
+qint64 Metrics::takeInput()
+{
+    if (s_emittedAt == 0) return 0;
+
+    qint64 inputAt = s_inputAt;
+    record(Dispatch, KeyInjector::now() - s_emittedAt);
+
+    s_inputAt = 0;
+    s_emittedAt = 0;
+    return inputAt;
+}
+
+QStringList Metrics::stages() const
+{
+    QStringList names;
+    for (int a = 0; a < StageCount; a++) {
+        names << QLatin1String(stageNames[a]);
+    }
+    return names;
+}
+
+QVariantMap Metrics::summary(const QString& stage) const
+{
+    QVariantMap values;
+
+    int index = stages().indexOf(stage);
+    if (index < 0) {
+        qWarning() << "Metrics: unknown stage" << stage;
+        return values;
+    }
+
+    const LatencyHistogram &histogram = s_histograms[index];
+    values.insert(QLatin1String("count"), histogram.count());
+    values.insert(QLatin1String("mean"), histogram.mean());
+    values.insert(QLatin1String("max"), histogram.max());
+    values.insert(QLatin1String("p50"), histogram.percentile(50));
+    values.insert(QLatin1String("p90"), histogram.percentile(90));
+    values.insert(QLatin1String("p99"), histogram.percentile(99));
+    values.insert(QLatin1String("p999"), histogram.percentile(99.9));
+    return values;
+}
+
+void Metrics::reset()
+{
+    for (int a = 0; a < StageCount; a++) {
+        s_histograms[a].reset();
+    }
+}
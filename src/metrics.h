@@ -0,0 +1,81 @@
+// Class Metrics: always-on key tap latency histograms
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+
+#include "latencyhistogram.h"
+
+/**
+ * Class Metrics:
+ * Latency of a key tap split at the stage boundaries, from the mouse
+ * press on a key to the flush of its XTest events:
+ *
+ *   input     mouse press handler until the key signal is emitted
+ *   dispatch  key signal until the stroke is queued for injection
+ *   inject    queued until flushed by the injection thread
+ *   total     mouse press until flushed
+ *
+ * and, apart from taps, the show latency of the keyboard:
+ *
+ *   show      show request until the keyboard has painted
+ *
+ * The static functions record, the instance exports the histograms over
+ * D-Bus as org.kde.kvkbd.Metrics.
+ */
+class Metrics : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Stage {
+        Input,
+        Dispatch,
+        Inject,
+        Total,
+        Show,
+        StageCount
+    };
+
+    explicit Metrics(QObject *parent = nullptr);
+
+    static void record(Stage stage, qint64 ns);
+    static const LatencyHistogram &histogram(Stage stage);
+
+    /**
+     * GUI thread. Marks the mouse press on a key and the emission of its
+     * key signal.
+     */
+    static void inputStarted();
+    static void keyEmitted();
+
+    /**
+     * GUI thread, as a stroke is queued. Records the dispatch stage of
+     * the tap being delivered.
+     *
+     * @return when the tap started, 0 for strokes no tap led to, such
+     * as autorepeat and typed text
+     */
+    static qint64 takeInput();
+
+public Q_SLOTS:
+    QStringList stages() const;
+
+    /**
+     * @return count, mean, max, p50, p90, p99 and p999 of @p stage, in ns
+     */
+    QVariantMap summary(const QString& stage) const;
+    void reset();
+
+protected:
+    static LatencyHistogram s_histograms[StageCount];
+    static qint64 s_inputAt;
+    static qint64 s_emittedAt;
+};
+
+#endif // METRICS_H
@@ -23,12 +23,44 @@
 
 #include <QPoint>
 #include <QPainter>
+#include <QLayout>
 
 #include <QMouseEvent>
 
+/**
+ * Class SnapshotView:
+ * Covers the keyboard during a live resize with a picture of it taken
+ * when the resize started, stretched to the current size.
+ */
+class SnapshotView : public QWidget
+{
+public:
+    explicit SnapshotView(QWidget *parent) : QWidget(parent)
+    {
+        setAttribute(Qt::WA_TransparentForMouseEvents);
+        hide();
+    }
+
+    void setPixmap(const QPixmap& pm)
+    {
+        this->pm = pm;
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent *) override
+    {
+        QPainter p(this);
+        p.drawPixmap(rect(), pm);
+    }
+
+    QPixmap pm;
+};
+
 ResizableDragWidget::ResizableDragWidget(QWidget *parent) :
-    DragWidget(parent), doResize(false)
+    DragWidget(parent), doResize(false), resizePending(false)
 {
+    snapshot = new SnapshotView(this);
 }
 
 ResizableDragWidget::~ResizableDragWidget()
@@ -45,6 +77,7 @@ void ResizableDragWidget::mousePressEvent(QMouseEvent * ev)
         dragPoint = QPoint(width() - ev->pos().x(), height() - ev->pos().y());
         dragged = false;
         doResize = true;
+        beginLiveResize();
     }
 }
 
@@ -61,16 +94,67 @@ void ResizableDragWidget::mouseMoveEvent(QMouseEvent * ev)
     int nw = curr.x() - pos.x() + dragPoint.x();
     int nh = curr.y() - pos.y() + dragPoint.y();
 
-    resize(nw, nh);
+    pendingSize = QSize(nw, nh);
+    resizePending = true;
+    scheduleGeometry();
 }
 
 void ResizableDragWidget::mouseReleaseEvent(QMouseEvent * e)
 {
     DragWidget::mouseReleaseEvent(e);
 
+    if (doResize) {
+        endLiveResize();
+    }
     doResize = false;
 }
 
+bool ResizableDragWidget::applyGeometry()
+{
+    bool applied = DragWidget::applyGeometry();
+
+    if (resizePending) {
+        resizePending = false;
+        resize(pendingSize);
+        applied = true;
+    }
+
+    return applied;
+}
+
+void ResizableDragWidget::resizeEvent(QResizeEvent *e)
+{
+    DragWidget::resizeEvent(e);
+
+    if (snapshot->isVisible()) {
+        snapshot->setGeometry(rect());
+    }
+}
+
+void ResizableDragWidget::beginLiveResize()
+{
+    if (!layout()) return;
+
+    snapshot->setPixmap(grab());
+    snapshot->setGeometry(rect());
+    snapshot->raise();
+    snapshot->show();
+
+    layout()->setEnabled(false);
+}
+
+void ResizableDragWidget::endLiveResize()
+{
+    if (!layout() || layout()->isEnabled()) return;
+
+    layout()->setEnabled(true);
+    layout()->invalidate();
+    layout()->activate();
+
+    snapshot->hide();
+    snapshot->setPixmap(QPixmap());
+}
+
 void ResizableDragWidget::paintEvent(QPaintEvent *ev)
 {
     DragWidget::paintEvent(ev);
@@ -3,6 +3,10 @@
 
 #include "dragwidget.h"
 
+#include <QSize>
+
+class SnapshotView;
+
 class ResizableDragWidget : public DragWidget
 {
     Q_OBJECT
@@ -16,8 +20,23 @@ protected:
     void mousePressEvent(QMouseEvent * e) override;
     void mouseReleaseEvent(QMouseEvent * e) override;
     void paintEvent(QPaintEvent *e) override;
+    void resizeEvent(QResizeEvent *e) override;
+
+    bool applyGeometry() override;
+
+    /**
+     * While the size follows the mouse the layout is suspended and the
+     * keys are shown as a scaled snapshot, they are laid out once at the
+     * final size by endLiveResize().
+     */
+    void beginLiveResize();
+    void endLiveResize();
 
     bool doResize;
+
+    QSize pendingSize;
+    bool resizePending;
+    SnapshotView *snapshot;
 };
 
 
@@ -0,0 +1,128 @@
+// Class SingleInstance: one kvkbd per X screen through a selection
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "singleinstance.h"
+#include "trace.h"
+#include "x11connection.h"
+
+#include <QDebug>
+#include <QSocketNotifier>
+
+#include <cstring>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+SingleInstance::SingleInstance(Role role, QObject *parent) : QObject(parent),
+    role(role), display(nullptr), window(0), commandAtom(0), notifier(nullptr)
+{
+    display = X11Connection::openPrivate();
+    if (!display) return;
+
+    commandAtom = XInternAtom(display, "_KVKBD_COMMAND", False);
+}
+
+SingleInstance::~SingleInstance()
+{
+    if (!display) return;
+
+    // Closing the connection gives up the selection
+    if (window) {
+        XDestroyWindow(display, window);
+    }
+    X11Connection::closePrivate(display);
+}
+
+unsigned long SingleInstance::selectionAtom(Role role)
+{
+    QByteArray name = role == LoginHelper ? "_KVKBD_LOGIN_S" : "_KVKBD_S";
+    name += QByteArray::number(DefaultScreen(display));
+    return XInternAtom(display, name.constData(), False);
+}
+
+unsigned long SingleInstance::serverTime()
+{
+    // ICCCM: a selection is taken with a real timestamp, not CurrentTime.
+    // Appending nothing to a property has the server send us one.
+    XChangeProperty(display, window, commandAtom, XA_STRING, 8, PropModeAppend, nullptr, 0);
+
+    XEvent event;
+    XWindowEvent(display, window, PropertyChangeMask, &event);
+    return event.xproperty.time;
+}
+
+bool SingleInstance::sendCommand(Role role, Command command)
+{
+    if (!display) return false;
+
+    Window owner = XGetSelectionOwner(display, selectionAtom(role));
+    if (owner == None || owner == window) return false;
+
+    XEvent event;
+    std::memset(&event, 0, sizeof(event));
+    event.xclient.type = ClientMessage;
+    event.xclient.window = owner;
+    event.xclient.message_type = commandAtom;
+    event.xclient.format = 32;
+    event.xclient.data.l[0] = command;
+
+    XSendEvent(display, owner, False, NoEventMask, &event);
+    XFlush(display);
+    return true;
+}
+
+bool SingleInstance::acquire()
+{
+    TRACE_SPAN("SingleInstance::acquire");
+    if (!display) return true;
+
+    // Already running, the running instance shows itself
+    if (sendCommand(role, Activate)) {
+        return false;
+    }
+
+    Window root = RootWindow(display, DefaultScreen(display));
+    XSetWindowAttributes attributes;
+    attributes.override_redirect = True;
+    attributes.event_mask = PropertyChangeMask;
+    window = XCreateWindow(display, root, -1, -1, 1, 1, 0, CopyFromParent, InputOnly, CopyFromParent,
+                           CWOverrideRedirect | CWEventMask, &attributes);
+
+    Atom selection = selectionAtom(role);
+    XSetSelectionOwner(display, selection, window, serverTime());
+
+    // Lost a race with another launch, which now runs
+    if (XGetSelectionOwner(display, selection) != window) {
+        return false;
+    }
+
+    notifier = new QSocketNotifier(ConnectionNumber(display), QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &SingleInstance::readEvents);
+    readEvents();
+    return true;
+}
+
+void SingleInstance::readEvents()
+{
+    while (XPending(display)) {
+        XEvent event;
+        XNextEvent(display, &event);
+
+        if (event.type == ClientMessage && event.xclient.message_type == commandAtom) {
+            switch (event.xclient.data.l[0]) {
+            case Activate:
+                Q_EMIT activateRequested();
+                break;
+            case Quit:
+                Q_EMIT quitRequested();
+                break;
+            }
+        }
+        else if (event.type == SelectionClear && event.xselectionclear.window == window) {
+            // Taken over by a launch that raced us, leave it the screen
+            qWarning() << "SingleInstance: selection taken by another instance, quitting";
+            Q_EMIT quitRequested();
+        }
+    }
+}
@@ -0,0 +1,74 @@
+// Class SingleInstance: one kvkbd per X screen through a selection
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+
+typedef struct _XDisplay Display;
+
+class QSocketNotifier;
+
+/**
+ * Class SingleInstance:
+ * The running keyboard owns the X selection _KVKBD_S<screen>, the login
+ * helper _KVKBD_LOGIN_S<screen>. A new launch looks up the owner in one
+ * round trip and, if there is one, sends it a client message instead of
+ * starting. The selections are held on a connection of their own, which
+ * the X server releases when the process ends however it ends.
+ */
+class SingleInstance : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        Keyboard,
+        LoginHelper
+    };
+
+    enum Command {
+        //show and raise the keyboard
+        Activate = 1,
+        Quit = 2
+    };
+
+    explicit SingleInstance(Role role, QObject *parent = nullptr);
+    ~SingleInstance();
+
+    /**
+     * Takes the selection of our role, or asks its owner to activate.
+     *
+     * @return true if this process is the instance and should start,
+     * also when there is no X server to ask
+     */
+    bool acquire();
+
+    /**
+     * Sends @p command to the instance running as @p role.
+     *
+     * @return false if there is none
+     */
+    bool sendCommand(Role role, Command command);
+
+Q_SIGNALS:
+    void activateRequested();
+    void quitRequested();
+
+protected Q_SLOTS:
+    void readEvents();
+
+protected:
+    unsigned long selectionAtom(Role role);
+    unsigned long serverTime();
+
+    Role role;
+    Display *display;
+    unsigned long window;
+    unsigned long commandAtom;
+    QSocketNotifier *notifier;
+};
+
+#endif // SINGLEINSTANCE_H
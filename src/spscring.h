@@ -0,0 +1,74 @@
+// Class SpscRing: lock-free single producer, single consumer ring buffer
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+/**
+ * Class SpscRing:
+ * Fixed capacity FIFO shared by exactly one producer thread and one
+ * consumer thread. Neither side ever blocks or allocates; the producer
+ * sees a full ring as a failed push().
+ */
+template<typename T, int Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0)
+    {
+    }
+
+    /**
+     * Producer side.
+     *
+     * @return false if the ring is full
+     */
+    bool push(const T &value)
+    {
+        const quint32 h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == (quint32)Capacity) {
+            return false;
+        }
+
+        buffer[h & (Capacity - 1)] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side.
+     *
+     * @return false if the ring is empty
+     */
+    bool pop(T &value)
+    {
+        const quint32 t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = buffer[t & (Capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // Separate cache lines so producer and consumer do not false share
+    alignas(64) std::atomic<quint32> head;
+    alignas(64) std::atomic<quint32> tail;
+    T buffer[Capacity];
+};
+
+#endif // SPSCRING_H
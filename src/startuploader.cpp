@@ -0,0 +1,94 @@
+// Class StartupLoader: reads the startup data on worker threads
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "startuploader.h"
+#include "themeloader.h"
+#include "trace.h"
+
+#include <QRunnable>
+
+#include <functional>
+
+//one per independent load, the theme and the color style
+#define STARTUP_THREADS 2
+
+class StartupTask : public QRunnable
+{
+public:
+    explicit StartupTask(const std::function<void()> &work) : work(work)
+    {
+    }
+
+    void run() override
+    {
+        work();
+    }
+
+private:
+    std::function<void()> work;
+};
+
+StartupLoader::StartupLoader() : themeResult(-1), styleLoaded(false)
+{
+    pool.setMaxThreadCount(STARTUP_THREADS);
+    // The pool is used once, do not keep idle threads around
+    pool.setExpiryTimeout(0);
+}
+
+StartupLoader::~StartupLoader()
+{
+    pool.waitForDone();
+}
+
+void StartupLoader::loadTheme(const QString& themeName, const QString& path)
+{
+    pool.start(new StartupTask([this, themeName, path]() {
+        TRACE_SPAN("StartupLoader::loadTheme");
+        themeResult = ThemeLoader::readTheme(themeName, path, themeData, &themeErrorText);
+    }));
+}
+
+void StartupLoader::loadColorStyle(const QString& fileName, const QPalette& palette)
+{
+    styleFile = fileName;
+    pool.start(new StartupTask([this, fileName, palette]() {
+        TRACE_SPAN("StartupLoader::loadColorStyle");
+        styleLoaded = style.load(fileName, palette);
+    }));
+}
+
+void StartupLoader::waitForDone()
+{
+    pool.waitForDone();
+}
+
+const ThemeData &StartupLoader::theme() const
+{
+    return themeData;
+}
+
+int StartupLoader::themeStatus() const
+{
+    return themeResult;
+}
+
+const QString &StartupLoader::themeError() const
+{
+    return themeErrorText;
+}
+
+const ColorStyle &StartupLoader::colorStyle() const
+{
+    return style;
+}
+
+bool StartupLoader::colorStyleLoaded() const
+{
+    return styleLoaded;
+}
+
+const QString &StartupLoader::colorFile() const
+{
+    return styleFile;
+}
@@ -0,0 +1,64 @@
+// Class StartupLoader: reads the startup data on worker threads
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef STARTUPLOADER_H
+#define STARTUPLOADER_H
+
+#include <QPalette>
+#include <QString>
+#include <QThreadPool>
+
+#include "colorstyle.h"
+#include "themedata.h"
+
+/**
+ * Class StartupLoader:
+ * Reads the theme and parses the color style on a small thread pool
+ * while the GUI thread connects to the X server and the session bus.
+ * The results are plain data; once waitForDone() returns, the GUI
+ * thread builds the widgets from them with ThemeLoader::buildLayout and
+ * ThemeLoader::applyColorStyle.
+ */
+class StartupLoader
+{
+public:
+    StartupLoader();
+    ~StartupLoader();
+
+    void loadTheme(const QString& themeName, const QString& path);
+
+    /**
+     * Parses @p fileName with the defaults of @p palette, taken on the
+     * GUI thread.
+     */
+    void loadColorStyle(const QString& fileName, const QPalette& palette);
+
+    /**
+     * Blocks until the queued loads are done.
+     */
+    void waitForDone();
+
+    //results, valid after waitForDone
+    const ThemeData &theme() const;
+    //0 on success, as ThemeLoader::readTheme
+    int themeStatus() const;
+    const QString &themeError() const;
+
+    const ColorStyle &colorStyle() const;
+    bool colorStyleLoaded() const;
+    const QString &colorFile() const;
+
+protected:
+    QThreadPool pool;
+
+    ThemeData themeData;
+    int themeResult;
+    QString themeErrorText;
+
+    ColorStyle style;
+    bool styleLoaded;
+    QString styleFile;
+};
+
+#endif // STARTUPLOADER_H
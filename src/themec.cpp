@@ -0,0 +1,294 @@
+// kvkbd-themec: compiles keyboard theme XML into the form loaded by kvkbd
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "themedata.h"
+
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QXmlStreamWriter>
+
+#include <cstring>
+#include <memory>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+static int keyCount(const ThemeData& theme)
+{
+    int count = 0;
+    for (const ThemePart &part : theme.parts) {
+        count += part.keys.size();
+    }
+    return count;
+}
+
+//bytes allocated on the heap and not freed, -1 if unknown
+static qint64 heapInUse()
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks;
+#else
+    return (unsigned int)mallinfo().uordblks;
+#endif
+#else
+    return -1;
+#endif
+}
+
+//bytes handed to the parser per read, each read samples the heap
+#define SAMPLE_BYTES 256
+
+/*
+ * Sequential device over the XML that hands it out in small reads and
+ * samples the heap in use before each one, so the samples follow the
+ * parse as it goes. Sampled, so the peak found is a lower bound.
+ */
+class HeapSamplingDevice : public QIODevice
+{
+public:
+    explicit HeapSamplingDevice(const QByteArray &data) : data(data), offset(0), peak(-1)
+    {
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    qint64 bytesAvailable() const override
+    {
+        return data.size() - offset + QIODevice::bytesAvailable();
+    }
+
+    void sample()
+    {
+        peak = qMax(peak, heapInUse());
+    }
+
+    qint64 peakHeap() const
+    {
+        return peak;
+    }
+
+protected:
+    qint64 readData(char *out, qint64 maxSize) override
+    {
+        sample();
+
+        qint64 size = qMin(qMin(maxSize, (qint64)SAMPLE_BYTES), (qint64)data.size() - offset);
+        std::memcpy(out, data.constData() + offset, size);
+        offset += size;
+        return size;
+    }
+
+    qint64 writeData(const char *, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    QByteArray data;
+    qint64 offset;
+    qint64 peak;
+};
+
+//peak resident set size of the process in KiB, -1 if unknown
+static qint64 peakResidentSize()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss;
+    }
+#endif
+    return -1;
+}
+
+//theme with @p keys keys in rows of 20, using every kind of size hint
+static QByteArray syntheticTheme(int keys)
+{
+    static const char *const colorGroups[] = {"normal", "function", "system", "other"};
+
+    QByteArray xml;
+    QXmlStreamWriter writer(&xml);
+    writer.setAutoFormatting(true);
+    writer.writeStartDocument();
+    writer.writeStartElement(QLatin1String("layout"));
+    writer.writeAttribute(QLatin1String("name"), QLatin1String("synthetic"));
+
+    writer.writeStartElement(QLatin1String("buttonWidth"));
+    writer.writeAttribute(QLatin1String("width"), QLatin1String("25"));
+    for (int a=0; a<8; a++) {
+        writer.writeEmptyElement(QLatin1String("item"));
+        writer.writeAttribute(QLatin1String("name"), QString::fromLatin1("Width%1").arg(a));
+        writer.writeAttribute(QLatin1String("width"), QString::number(20 + 5 * a));
+    }
+    writer.writeEndElement();
+
+    writer.writeStartElement(QLatin1String("buttonHeight"));
+    writer.writeAttribute(QLatin1String("height"), QLatin1String("25"));
+    writer.writeEmptyElement(QLatin1String("item"));
+    writer.writeAttribute(QLatin1String("name"), QLatin1String("Tall"));
+    writer.writeAttribute(QLatin1String("height"), QLatin1String("50"));
+    writer.writeEndElement();
+
+    writer.writeStartElement(QLatin1String("spacingHints"));
+    writer.writeEmptyElement(QLatin1String("item"));
+    writer.writeAttribute(QLatin1String("name"), QLatin1String("Gap"));
+    writer.writeAttribute(QLatin1String("width"), QLatin1String("5"));
+    writer.writeEndElement();
+
+    writer.writeStartElement(QLatin1String("part"));
+    writer.writeAttribute(QLatin1String("name"), QLatin1String("main"));
+    for (int a=0; a<keys; a++) {
+        if (a % 20 == 0) {
+            if (a > 0) writer.writeEndElement();
+            writer.writeStartElement(QLatin1String("row"));
+        }
+        else if (a % 10 == 0) {
+            writer.writeEmptyElement(QLatin1String("spacing"));
+            writer.writeAttribute(QLatin1String("width"), QLatin1String("Gap"));
+        }
+        writer.writeEmptyElement(QLatin1String("key"));
+        writer.writeAttribute(QLatin1String("code"), QString::number(8 + a % 248));
+        writer.writeAttribute(QLatin1String("width"), QString::fromLatin1("Width%1").arg(a % 8));
+        if (a % 50 == 0) {
+            writer.writeAttribute(QLatin1String("height"), QLatin1String("Tall"));
+        }
+        writer.writeAttribute(QLatin1String("label"), QString::fromLatin1("K%1").arg(a));
+        writer.writeAttribute(QLatin1String("colorGroup"), QLatin1String(colorGroups[a % 4]));
+        writer.writeAttribute(QLatin1String("tooltip"), QString::fromLatin1("Synthetic key %1").arg(a));
+    }
+    writer.writeEndDocument();
+    return xml;
+}
+
+static void runBenchmark(const QByteArray& xml, const QByteArray& binary, int runs)
+{
+    QTextStream out(stdout);
+    QElapsedTimer timer;
+
+    timer.start();
+    for (int a=0; a<runs; a++) {
+        ThemeData theme;
+        QBuffer buffer;
+        buffer.setData(xml);
+        buffer.open(QIODevice::ReadOnly);
+        theme.loadXml(&buffer);
+    }
+    qint64 xmlNs = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int a=0; a<runs; a++) {
+        ThemeData theme;
+        theme.loadBinary(reinterpret_cast<const uchar*>(binary.constData()), binary.size());
+    }
+    qint64 binaryNs = timer.nsecsElapsed();
+
+    out << "xml:      " << xml.size() << " bytes, " << xmlNs / runs / 1000.0 << " us per load\n";
+    out << "compiled: " << binary.size() << " bytes, " << binaryNs / runs / 1000.0 << " us per load\n";
+    out << "speedup:  " << (binaryNs > 0 ? (double)xmlNs / binaryNs : 0.0) << "x over " << runs << " runs\n";
+
+    qint64 before = heapInUse();
+    qint64 peakXml = -1;
+    std::unique_ptr<ThemeData> theme(new ThemeData);
+    {
+        HeapSamplingDevice device(xml);
+        device.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        device.sample();
+        theme->loadXml(&device);
+        device.sample();
+        peakXml = device.peakHeap();
+    }
+    qint64 afterXml = heapInUse();
+    theme.reset(new ThemeData);
+    qint64 base = heapInUse();
+    theme->loadBinary(reinterpret_cast<const uchar*>(binary.constData()), binary.size());
+    qint64 afterBinary = heapInUse();
+
+    if (before >= 0) {
+        out << "heap held by a loaded theme: " << afterXml - before << " bytes from xml, "
+            << afterBinary - base << " bytes from the compiled form\n";
+        out << "peak heap while parsing the xml: " << peakXml - before << " bytes, sampled every "
+            << SAMPLE_BYTES << " bytes read\n";
+    }
+    out << "peak resident size of the process: " << peakResidentSize() << " KiB\n";
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QLatin1String("kvkbd-themec"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("Compiles a kvkbd theme XML file into its binary form"));
+    parser.addHelpOption();
+
+    QCommandLineOption benchmarkOption(QLatin1String("benchmark"),
+                                       QLatin1String("Compare loading the theme from XML and from the compiled form over <runs> loads."),
+                                       QLatin1String("runs"));
+    parser.addOption(benchmarkOption);
+    QCommandLineOption syntheticOption(QLatin1String("synthetic"),
+                                       QLatin1String("Use a generated theme of <keys> keys instead of the input file."),
+                                       QLatin1String("keys"));
+    parser.addOption(syntheticOption);
+    parser.addPositionalArgument(QLatin1String("input"), QLatin1String("Theme XML file, - with --synthetic."));
+    parser.addPositionalArgument(QLatin1String("output"), QLatin1String("Compiled theme file."), QLatin1String("[output]"));
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    QTextStream err(stderr);
+    QByteArray xml;
+
+    if (parser.isSet(syntheticOption)) {
+        xml = syntheticTheme(qMax(1, parser.value(syntheticOption).toInt()));
+    }
+    else {
+        QFile input(args.at(0));
+        if (!input.open(QIODevice::ReadOnly)) {
+            err << "kvkbd-themec: unable to open " << input.fileName() << "\n";
+            return 1;
+        }
+        xml = input.readAll();
+    }
+
+    ThemeData theme;
+    QBuffer buffer(&xml);
+    buffer.open(QIODevice::ReadOnly);
+    QString error;
+    if (!theme.loadXml(&buffer, &error)) {
+        err << args.at(0) << ": " << error << "\n";
+        return 1;
+    }
+
+    QByteArray binary = theme.toBinary();
+
+    if (args.size() > 1) {
+        QFile output(args.at(1));
+        if (!output.open(QIODevice::WriteOnly) || output.write(binary) != binary.size()) {
+            err << "kvkbd-themec: unable to write " << output.fileName() << "\n";
+            return 1;
+        }
+    }
+
+    if (parser.isSet(benchmarkOption)) {
+        QTextStream(stdout) << theme.name << ": " << theme.parts.size() << " parts, " << keyCount(theme) << " keys\n";
+        runBenchmark(xml, binary, qMax(1, parser.value(benchmarkOption).toInt()));
+    }
+
+    return 0;
+}
@@ -0,0 +1,534 @@
+// Class ThemeData: keyboard theme in memory, read from XML or compiled form
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "themedata.h"
+
+#include <QHash>
+#include <QIODevice>
+#include <QXmlStreamReader>
+
+#include <cstring>
+
+namespace {
+
+/*
+ * Compiled layout: FileHeader, then the PartRecord, KeyRecord and
+ * StringRecord tables, then the UTF-16 characters of all strings. All
+ * values are in host byte order, every table starts 4 byte aligned.
+ */
+const char Magic[4] = {'K', 'V', 'K', 'T'};
+const quint32 ByteOrderMark = 0x01020304;
+
+struct FileHeader
+{
+    char magic[4];
+    quint16 version;
+    quint16 reserved;
+    quint32 byteOrder;
+    quint32 nameString;
+    quint32 partCount;
+    quint32 partOffset;
+    quint32 keyCount;
+    quint32 keyOffset;
+    quint32 stringCount;
+    quint32 stringOffset;
+    quint32 charCount;
+    quint32 charOffset;
+};
+
+struct PartRecord
+{
+    quint32 nameString;
+    qint32 width;
+    qint32 height;
+    qint32 rows;
+    qint32 columns;
+    quint32 firstKey;
+    quint32 keyCount;
+};
+
+enum KeyString {
+    NameString,
+    LabelString,
+    GroupLabelString,
+    GroupToggleString,
+    GroupNameString,
+    ColorGroupString,
+    ActionString,
+    TooltipString,
+    KeyStringCount
+};
+
+QString KeyDescriptor::* const keyStrings[KeyStringCount] = {
+    &KeyDescriptor::name,
+    &KeyDescriptor::label,
+    &KeyDescriptor::groupLabel,
+    &KeyDescriptor::groupToggle,
+    &KeyDescriptor::groupName,
+    &KeyDescriptor::colorGroup,
+    &KeyDescriptor::action,
+    &KeyDescriptor::tooltip
+};
+
+struct KeyRecord
+{
+    qint32 x;
+    qint32 y;
+    qint32 width;
+    qint32 height;
+    quint32 keyCode;
+    quint32 flags;
+    quint32 strings[KeyStringCount];
+};
+
+struct StringRecord
+{
+    quint32 offset;
+    quint32 length;
+};
+
+//string table where equal strings are stored once, index 0 is the empty string
+class StringPool
+{
+public:
+    StringPool()
+    {
+        intern(QString());
+    }
+
+    quint32 intern(const QString &string)
+    {
+        auto itr = index.constFind(string);
+        if (itr != index.constEnd()) {
+            return itr.value();
+        }
+
+        StringRecord record;
+        record.offset = chars.size();
+        record.length = string.size();
+        chars += string;
+        records.append(record);
+
+        quint32 id = records.size() - 1;
+        index.insert(string, id);
+        return id;
+    }
+
+    QHash<QString, quint32> index;
+    QVector<StringRecord> records;
+    QString chars;
+};
+
+template<typename T>
+void appendRaw(QByteArray &out, const T *data, int count)
+{
+    out.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+bool tableFits(qint64 size, quint32 offset, quint32 count, size_t recordSize)
+{
+    return offset % 4 == 0 && offset <= size && count <= (quint64)(size - offset) / recordSize;
+}
+
+/*
+ * Single pass reader of the theme XML. Size hint names are turned into
+ * small integers as they are met, so keys only record hint ids and the
+ * positions are computed afterwards from plain arrays. This also lets
+ * the hint sections appear after the parts that use them.
+ */
+class ThemeXmlReader
+{
+public:
+    bool read(QIODevice *device, ThemeData& theme, QString *errorMessage);
+
+private:
+    enum HintKind {
+        WidthHint,
+        HeightHint,
+        SpacingHint,
+        HintKindCount
+    };
+
+    struct LayoutItem
+    {
+        //index into ThemePart::keys, -1 for spacing
+        int key;
+        int width;
+        int height;
+    };
+
+    struct RowLayout
+    {
+        int height;
+        int firstItem;
+        int itemCount;
+    };
+
+    struct PartLayout
+    {
+        QVector<RowLayout> rows;
+        QVector<LayoutItem> items;
+    };
+
+    int hintId(const QString& name);
+    int hintValue(HintKind kind, int id, int defaultValue) const;
+    void readHints(HintKind kind, const QString& valueName);
+    void readRow(ThemePart& part, PartLayout& layout);
+    void layoutPart(ThemePart& part, const PartLayout& layout) const;
+
+    QXmlStreamReader xml;
+    QHash<QString, int> hintIds;
+    QVector<int> hintValues[HintKindCount];
+    int defaultWidth = 25;
+    int defaultHeight = 25;
+};
+
+int ThemeXmlReader::hintId(const QString& name)
+{
+    if (name.isEmpty()) return -1;
+
+    auto itr = hintIds.constFind(name);
+    if (itr != hintIds.constEnd()) {
+        return itr.value();
+    }
+
+    int id = hintIds.size();
+    hintIds.insert(name, id);
+    for (QVector<int> &values : hintValues) {
+        values.append(-1);
+    }
+    return id;
+}
+
+int ThemeXmlReader::hintValue(HintKind kind, int id, int defaultValue) const
+{
+    if (id < 0) return defaultValue;
+
+    int value = hintValues[kind].at(id);
+    return value < 0 ? defaultValue : value;
+}
+
+void ThemeXmlReader::readHints(HintKind kind, const QString& valueName)
+{
+    while (xml.readNextStartElement()) {
+        if (xml.name() == QLatin1String("item")) {
+            QXmlStreamAttributes attributes = xml.attributes();
+            int id = hintId(attributes.value(QLatin1String("name")).toString());
+            if (id >= 0) {
+                hintValues[kind][id] = attributes.value(valueName).toInt();
+            }
+        }
+        xml.skipCurrentElement();
+    }
+}
+
+void ThemeXmlReader::readRow(ThemePart& part, PartLayout& layout)
+{
+    RowLayout row;
+    row.height = hintId(xml.attributes().value(QLatin1String("height")).toString());
+    row.firstItem = layout.items.size();
+
+    while (xml.readNextStartElement()) {
+        QXmlStreamAttributes attributes = xml.attributes();
+
+        LayoutItem item;
+        item.key = -1;
+        item.width = hintId(attributes.value(QLatin1String("width")).toString());
+        item.height = hintId(attributes.value(QLatin1String("height")).toString());
+
+        if (xml.name() == QLatin1String("key")) {
+            KeyDescriptor key;
+
+            key.name = attributes.value(QLatin1String("name")).toString();
+            key.label = attributes.value(QLatin1String("label")).toString();
+            key.groupLabel = attributes.value(QLatin1String("group_label")).toString();
+            key.groupToggle = attributes.value(QLatin1String("group_toggle")).toString();
+            key.groupName = attributes.value(QLatin1String("group_name")).toString();
+            key.colorGroup = attributes.value(QLatin1String("colorGroup")).toString();
+            if (key.colorGroup.isEmpty()) {
+                key.colorGroup = QLatin1String("normal");
+            }
+            key.tooltip = attributes.value(QLatin1String("tooltip")).toString();
+            key.action = attributes.value(QLatin1String("action")).toString();
+
+            key.keyCode = attributes.value(QLatin1String("code")).toUInt();
+            if (attributes.value(QLatin1String("modifier")).toInt() > 0) {
+                key.flags |= KeyDescriptor::Modifier;
+            }
+            if (attributes.value(QLatin1String("checkable")).toInt() > 0) {
+                key.flags |= KeyDescriptor::Checkable;
+            }
+
+            item.key = part.keys.size();
+            part.keys.append(key);
+            layout.items.append(item);
+        }
+        else if (xml.name() == QLatin1String("spacing")) {
+            layout.items.append(item);
+        }
+        xml.skipCurrentElement();
+    }
+
+    row.itemCount = layout.items.size() - row.firstItem;
+    layout.rows.append(row);
+}
+
+void ThemeXmlReader::layoutPart(ThemePart& part, const PartLayout& layout) const
+{
+    int max_sx = 0;
+    int sy = 0;
+
+    for (const RowLayout &row : layout.rows) {
+        int rowHeight = hintValue(HeightHint, row.height, defaultHeight);
+        int row_buttons = 0;
+        int sx = 0;
+
+        for (int a=row.firstItem; a<row.firstItem+row.itemCount; a++) {
+            const LayoutItem &item = layout.items.at(a);
+
+            if (item.key >= 0) {
+                int buttonWidth = hintValue(WidthHint, item.width, defaultWidth);
+                int buttonHeight = hintValue(HeightHint, item.height, defaultHeight);
+                part.keys[item.key].rect = QRect(sx, sy, buttonWidth, buttonHeight);
+
+                sx += buttonWidth;
+                row_buttons++;
+            }
+            else {
+                sx += hintValue(SpacingHint, item.width, 0);
+                rowHeight = qMax(rowHeight, hintValue(HeightHint, item.height, 0));
+            }
+        }
+
+        if (sx>max_sx) max_sx = sx;
+        sy += rowHeight;
+
+        if (row_buttons>part.columns) part.columns=row_buttons;
+    }
+
+    part.rows = layout.rows.size();
+    part.baseSize = QSize(max_sx, sy);
+}
+
+bool ThemeXmlReader::read(QIODevice *device, ThemeData& theme, QString *errorMessage)
+{
+    xml.setDevice(device);
+
+    ThemeData loaded;
+    PartLayout layouts[2];
+    //part receiving the rows, main or extension
+    int current = -1;
+
+    if (xml.readNextStartElement()) {
+        loaded.name = xml.attributes().value(QLatin1String("name")).toString();
+    }
+
+    while (!xml.atEnd() && !xml.hasError()) {
+        QXmlStreamReader::TokenType token = xml.readNext();
+
+        if (token == QXmlStreamReader::EndElement) {
+            if (xml.name() == QLatin1String("extension")) {
+                current = 0;
+            }
+            else if (xml.name() == QLatin1String("part")) {
+                current = -1;
+            }
+            continue;
+        }
+        if (token != QXmlStreamReader::StartElement) continue;
+
+        if (xml.name() == QLatin1String("buttonWidth")) {
+            defaultWidth = xml.attributes().value(QLatin1String("width")).toInt();
+            readHints(WidthHint, QLatin1String("width"));
+        }
+        else if (xml.name() == QLatin1String("buttonHeight")) {
+            readHints(HeightHint, QLatin1String("height"));
+        }
+        else if (xml.name() == QLatin1String("spacingHints")) {
+            readHints(SpacingHint, QLatin1String("width"));
+        }
+        else if (xml.name() == QLatin1String("part") && loaded.parts.isEmpty()) {
+            ThemePart part;
+            part.name = QLatin1String("main");
+            loaded.parts.append(part);
+            current = 0;
+        }
+        else if (xml.name() == QLatin1String("extension") && current == 0 && loaded.parts.size() == 1) {
+            ThemePart part;
+            part.name = QLatin1String("extension");
+            loaded.parts.append(part);
+            current = 1;
+        }
+        else if (xml.name() == QLatin1String("row") && current >= 0) {
+            readRow(loaded.parts[current], layouts[current]);
+        }
+        else {
+            xml.skipCurrentElement();
+        }
+    }
+
+    if (xml.hasError()) {
+        if (errorMessage) {
+            *errorMessage = QString::fromLatin1("line %1: %2").arg(xml.lineNumber()).arg(xml.errorString());
+        }
+        return false;
+    }
+    if (loaded.parts.isEmpty()) {
+        if (errorMessage) {
+            *errorMessage = QLatin1String("no keyboard part");
+        }
+        return false;
+    }
+
+    for (int a=0; a<loaded.parts.size(); a++) {
+        layoutPart(loaded.parts[a], layouts[a]);
+    }
+
+    theme.name = loaded.name;
+    theme.parts = loaded.parts;
+    return true;
+}
+
+}
+
+bool ThemeData::loadXml(QIODevice *device, QString *errorMessage)
+{
+    ThemeXmlReader reader;
+    return reader.read(device, *this, errorMessage);
+}
+
+bool ThemeData::loadBinary(const uchar *data, qint64 size)
+{
+    if (!data || size < (qint64)sizeof(FileHeader)) return false;
+
+    const FileHeader *header = reinterpret_cast<const FileHeader*>(data);
+    if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0
+        || header->version != BinaryVersion
+        || header->byteOrder != ByteOrderMark) {
+        return false;
+    }
+
+    if (!tableFits(size, header->partOffset, header->partCount, sizeof(PartRecord))
+        || !tableFits(size, header->keyOffset, header->keyCount, sizeof(KeyRecord))
+        || !tableFits(size, header->stringOffset, header->stringCount, sizeof(StringRecord))
+        || !tableFits(size, header->charOffset, header->charCount, sizeof(QChar))) {
+        return false;
+    }
+
+    const PartRecord *partRecords = reinterpret_cast<const PartRecord*>(data + header->partOffset);
+    const KeyRecord *keyRecords = reinterpret_cast<const KeyRecord*>(data + header->keyOffset);
+    const StringRecord *stringRecords = reinterpret_cast<const StringRecord*>(data + header->stringOffset);
+    const QChar *chars = reinterpret_cast<const QChar*>(data + header->charOffset);
+
+    //each distinct string is built once, descriptors share it
+    QVector<QString> strings(header->stringCount);
+    for (quint32 a=0; a<header->stringCount; a++) {
+        const StringRecord &record = stringRecords[a];
+        if (record.offset > header->charCount || record.length > header->charCount - record.offset) {
+            return false;
+        }
+        strings[a] = QString(chars + record.offset, record.length);
+    }
+
+    bool valid = true;
+    auto string = [&](quint32 index) {
+        if (index >= (quint32)strings.size()) {
+            valid = false;
+            return QString();
+        }
+        return strings.at(index);
+    };
+
+    QVector<ThemePart> loaded(header->partCount);
+    for (quint32 a=0; a<header->partCount; a++) {
+        const PartRecord &record = partRecords[a];
+        if (record.firstKey > header->keyCount || record.keyCount > header->keyCount - record.firstKey) {
+            return false;
+        }
+
+        ThemePart &part = loaded[a];
+        part.name = string(record.nameString);
+        part.baseSize = QSize(record.width, record.height);
+        part.rows = record.rows;
+        part.columns = record.columns;
+        part.keys.resize(record.keyCount);
+
+        for (quint32 b=0; b<record.keyCount; b++) {
+            const KeyRecord &keyRecord = keyRecords[record.firstKey + b];
+            KeyDescriptor &key = part.keys[b];
+
+            key.rect = QRect(keyRecord.x, keyRecord.y, keyRecord.width, keyRecord.height);
+            key.keyCode = keyRecord.keyCode;
+            key.flags = keyRecord.flags;
+            for (int c=0; c<KeyStringCount; c++) {
+                key.*keyStrings[c] = string(keyRecord.strings[c]);
+            }
+        }
+    }
+
+    QString themeName = string(header->nameString);
+    if (!valid) return false;
+
+    name = themeName;
+    parts = loaded;
+    return true;
+}
+
+QByteArray ThemeData::toBinary() const
+{
+    StringPool pool;
+    QVector<PartRecord> partRecords;
+    QVector<KeyRecord> keyRecords;
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = BinaryVersion;
+    header.byteOrder = ByteOrderMark;
+    header.nameString = pool.intern(name);
+
+    for (const ThemePart &part : parts) {
+        PartRecord record;
+        record.nameString = pool.intern(part.name);
+        record.width = part.baseSize.width();
+        record.height = part.baseSize.height();
+        record.rows = part.rows;
+        record.columns = part.columns;
+        record.firstKey = keyRecords.size();
+        record.keyCount = part.keys.size();
+        partRecords.append(record);
+
+        for (const KeyDescriptor &key : part.keys) {
+            KeyRecord keyRecord;
+            keyRecord.x = key.rect.x();
+            keyRecord.y = key.rect.y();
+            keyRecord.width = key.rect.width();
+            keyRecord.height = key.rect.height();
+            keyRecord.keyCode = key.keyCode;
+            keyRecord.flags = key.flags;
+            for (int c=0; c<KeyStringCount; c++) {
+                keyRecord.strings[c] = pool.intern(key.*keyStrings[c]);
+            }
+            keyRecords.append(keyRecord);
+        }
+    }
+
+    header.partCount = partRecords.size();
+    header.partOffset = sizeof(FileHeader);
+    header.keyCount = keyRecords.size();
+    header.keyOffset = header.partOffset + header.partCount * sizeof(PartRecord);
+    header.stringCount = pool.records.size();
+    header.stringOffset = header.keyOffset + header.keyCount * sizeof(KeyRecord);
+    header.charCount = pool.chars.size();
+    header.charOffset = header.stringOffset + header.stringCount * sizeof(StringRecord);
+
+    QByteArray out;
+    out.reserve(header.charOffset + header.charCount * sizeof(QChar));
+    appendRaw(out, &header, 1);
+    appendRaw(out, partRecords.constData(), partRecords.size());
+    appendRaw(out, keyRecords.constData(), keyRecords.size());
+    appendRaw(out, pool.records.constData(), pool.records.size());
+    appendRaw(out, pool.chars.constData(), pool.chars.size());
+    return out;
+}
@@ -0,0 +1,62 @@
+// Class ThemeData: keyboard theme in memory, read from XML or compiled form
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef THEMEDATA_H
+#define THEMEDATA_H
+
+#include <QByteArray>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "keydescriptor.h"
+
+class QIODevice;
+
+/**
+ * Struct ThemePart:
+ * One block of keys placed in the keyboard grid, "main" or "extension".
+ */
+struct ThemePart
+{
+    QString name;
+    //extent of the keys in theme units
+    QSize baseSize;
+    int rows = 0;
+    int columns = 0;
+    QVector<KeyDescriptor> keys;
+};
+
+/**
+ * Class ThemeData:
+ * The parts and keys of a theme with every size hint resolved. It is read
+ * either from the theme XML or from the compiled form written by
+ * kvkbd-themec. The compiled form is a flat table of fixed size
+ * records and interned UTF-16 strings meant to be used straight from a
+ * mapped file, so loading it involves no parsing at all.
+ *
+ * Only depends on QtCore, it is shared by kvkbd and the compiler.
+ */
+class ThemeData
+{
+public:
+    //bumped whenever the compiled layout changes, older files are ignored
+    static const quint16 BinaryVersion = 1;
+
+    bool loadXml(QIODevice *device, QString *errorMessage = nullptr);
+
+    /**
+     * Reads a compiled theme from @p data, typically a mapped file.
+     * Nothing is referenced after the call returns.
+     *
+     * @return false if the data is truncated, corrupt or of another version
+     */
+    bool loadBinary(const uchar *data, qint64 size);
+    QByteArray toBinary() const;
+
+    QString name;
+    QVector<ThemePart> parts;
+};
+
+#endif // THEMEDATA_H
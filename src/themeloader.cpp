@@ -19,32 +19,46 @@
  */
 
 #include "themeloader.h"
+#include "keyboardsurface.h"
+#include "trace.h"
 
 #include <QActionGroup>
 #include <QApplication>
 #include <QMessageBox>
 #include <QString>
 #include <QFile>
-#include <QDomDocument>
-#include <QDomElement>
-#include <QDomNode>
-#include <QDomNodeList>
+#include <QDebug>
 #include <QFileInfo>
 #include <QDir>
 #include <QMenu>
 #include <QStandardPaths>
 
-int defaultWidth = 25;
-int defaultHeight = 25;
-
 #define DEFAULT_CSS QLatin1String(":/colors/standard.css")
 
-ThemeLoader::ThemeLoader(QWidget *parent) : QObject(parent)
+ThemeLoader::ThemeLoader(QWidget *parent) : QObject(parent), paintedKeys(false), styleSheets(false)
 {
 }
 
 ThemeLoader::~ThemeLoader()
 {
+    if (ColorStyle::active() == &colorStyle) {
+        ColorStyle::setActive(nullptr);
+    }
+}
+
+void ThemeLoader::setPaintedKeys(bool painted)
+{
+    paintedKeys = painted;
+}
+
+void ThemeLoader::setStyleSheets(bool enabled)
+{
+    styleSheets = enabled;
+}
+
+void ThemeLoader::setDeferredParts(const QStringList& partNames)
+{
+    deferredParts = partNames;
 }
 
 void ThemeLoader::loadTheme(QString& themeName)
@@ -60,6 +74,18 @@ void ThemeLoader::loadTheme(QString& themeName)
 }
 void ThemeLoader::loadColorFile(const QString& fileName)
 {
+    TRACE_SPAN("ThemeLoader::loadColorFile");
+
+    if (!styleSheets) {
+        ColorStyle style;
+        if (!style.load(fileName)) {
+            QMessageBox::information(nullptr, QLatin1String("Error"), QLatin1String("Unable to open css file: %1").arg(fileName));
+            return;
+        }
+        applyColorStyle(style, fileName);
+        return;
+    }
+
     QFile themeFile;
 
     themeFile.setFileName(fileName);
@@ -70,6 +96,7 @@ void ThemeLoader::loadColorFile(const QString& fileName)
         return;
     }
 
+    ColorStyle::setActive(nullptr);
     ((QWidget*)parent())->setStyleSheet(QString::fromLatin1(themeFile.readAll()));
     ((QWidget*)parent())->setProperty("colors", fileName);
     themeFile.close();
@@ -78,6 +105,23 @@ void ThemeLoader::loadColorFile(const QString& fileName)
 
     Q_EMIT colorStyleChanged();
 }
+void ThemeLoader::applyColorStyle(const ColorStyle& style, const QString& fileName)
+{
+    colorStyle = style;
+    ColorStyle::setActive(&colorStyle);
+
+    ((QWidget*)parent())->setStyleSheet(QString());
+    ((QWidget*)parent())->setProperty("colors", fileName);
+    ((QWidget*)parent())->repaint();
+
+    Q_EMIT colorStyleChanged();
+}
+
+bool ThemeLoader::usesStyleSheets() const
+{
+    return styleSheets;
+}
+
 void ThemeLoader::loadColorStyle()
 {
     QAction *action = (QAction*)QObject::sender();
@@ -88,6 +132,7 @@ void ThemeLoader::loadColorStyle()
 }
 void ThemeLoader::findColorStyles(QMenu *colors, const QString& configSelectedStyle)
 {
+    TRACE_SPAN("ThemeLoader::findColorStyles");
     QActionGroup *color_group = new QActionGroup(colors);
     color_group->setExclusive(true);
     colors->setTitle(QLatin1String("Color Style"));
@@ -111,6 +156,7 @@ void ThemeLoader::findColorStyles(QMenu *colors, const QString& configSelectedSt
         selectedStyle = DEFAULT_CSS;
     }
     QAction *selectedAction = nullptr;
+    bool applied = ((QWidget*)parent())->property("colors").toString() == selectedStyle;
 
     QListIterator<QAction*> itrActions(color_group->actions());
     while (itrActions.hasNext()) {
@@ -123,236 +169,184 @@ void ThemeLoader::findColorStyles(QMenu *colors, const QString& configSelectedSt
         connect(item, SIGNAL(triggered(bool)), this, SLOT(loadColorStyle()));
     }
 
-    if (selectedAction) {
+    if (selectedAction && !applied) {
         selectedAction->trigger();
     }
 }
 
-int ThemeLoader::loadLayout(const QString& themeName, const QString& path)
+QString ThemeLoader::selectedColorFile(const QString& configSelectedStyle)
 {
-    QFile themeFile;
-    QDomDocument doc;
-
-    themeFile.setFileName(QString(path + QLatin1String("%1.xml")).arg(themeName));
-
-    if (!themeFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QMessageBox::information(nullptr, QLatin1String("Error"), QLatin1String("Unable to open theme xml file: %1").arg(themeFile.fileName()));
-        return -1;
+    if (configSelectedStyle.length() < 1 || !QFile::exists(configSelectedStyle)) {
+        return DEFAULT_CSS;
     }
-    if (!doc.setContent(&themeFile)) {
-        QMessageBox::information(nullptr, QLatin1String("Error"), QLatin1String("Unable to parse theme xml file: %1").arg(themeFile.fileName()));
-        return -2;
-    }
-    themeFile.close();
+    return configSelectedStyle;
+}
 
-    QDomElement docElem = doc.documentElement();
+void ThemeLoader::loadSelectedColorStyle(const QString& configSelectedStyle)
+{
+    loadColorFile(selectedColorFile(configSelectedStyle));
+}
 
-    QDomNodeList wList = docElem.elementsByTagName(QLatin1String("buttonWidth"));
-    QDomNode wNode = wList.at(0);
+bool ThemeLoader::loadCompiledTheme(const QString& themeName, const QString& path, ThemeData& theme)
+{
+    TRACE_SPAN("ThemeLoader::loadCompiledTheme");
+    QString fileName = QString(path + QLatin1String("%1.kvt")).arg(themeName);
 
-    //read default button width
-    defaultWidth = wNode.attributes().namedItem(QLatin1String("width")).toAttr().value().toInt();
+    QFile themeFile(fileName);
+    if (!themeFile.open(QIODevice::ReadOnly)) return false;
 
-    QDomNodeList nList = (wNode.toElement()).elementsByTagName(QLatin1String("item"));
-    for (int a=0; a<nList.count(); a++) {
-        QDomNode node = nList.at(a);
-        int width = node.attributes().namedItem(QLatin1String("width")).toAttr().value().toInt();
-        QString hintName = node.attributes().namedItem(QLatin1String("name")).toAttr().value();
-        widthMap.insert(hintName, width);
+    bool loaded;
+    uchar *data = themeFile.map(0, themeFile.size());
+    if (data && reinterpret_cast<quintptr>(data) % 4 == 0) {
+        loaded = theme.loadBinary(data, themeFile.size());
+        themeFile.unmap(data);
     }
-
-    wList = docElem.elementsByTagName(QLatin1String("buttonHeight"));
-    wNode = wList.at(0);
-    nList = (wNode.toElement()).elementsByTagName(QLatin1String("item"));
-    for (int a=0; a<nList.count(); a++) {
-        QDomNode node = nList.at(a);
-        int height = node.attributes().namedItem(QLatin1String("height")).toAttr().value().toInt();
-        QString hintName = node.attributes().namedItem(QLatin1String("name")).toAttr().value();
-        heightMap.insert(hintName, height);
+    else {
+        // The tables are read in place and need 4 byte alignment
+        if (data) themeFile.unmap(data);
+        QByteArray copy = themeFile.readAll();
+        loaded = theme.loadBinary(reinterpret_cast<const uchar*>(copy.constData()), copy.size());
     }
 
-    wList = docElem.elementsByTagName(QLatin1String("spacingHints"));
-    wNode = wList.at(0);
-    nList = (wNode.toElement()).elementsByTagName(QLatin1String("item"));
-    for (int a=0; a<nList.count(); a++) {
-        QDomNode node = nList.at(a);
-        int width = node.attributes().namedItem(QLatin1String("width")).toAttr().value().toInt();
-        QString hintName = node.attributes().namedItem(QLatin1String("name")).toAttr().value();
-        spacingMap.insert(hintName, width);
+    if (!loaded) {
+        qWarning() << "ThemeLoader: ignoring stale or corrupt compiled theme" << fileName;
     }
+    return loaded;
+}
 
-    wList = docElem.elementsByTagName(QLatin1String("part"));
-    wNode = wList.at(0);
+int ThemeLoader::readTheme(const QString& themeName, const QString& path, ThemeData& theme, QString *error)
+{
+    TRACE_SPAN("ThemeLoader::readTheme");
 
-    //insert main part to widget
-    QString partName = wNode.attributes().namedItem(QLatin1String("name")).toAttr().value();
+    theme = ThemeData();
+    if (!loadCompiledTheme(themeName, path, theme)) {
+        QFile themeFile;
+        themeFile.setFileName(QString(path + QLatin1String("%1.xml")).arg(themeName));
 
-    MainWidget *part = new MainWidget((QWidget*)parent());
-    part->setProperty("part", QLatin1String("main"));
+        if (!themeFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            if (error) *error = QLatin1String("Unable to open theme xml file: %1").arg(themeFile.fileName());
+            return -1;
+        }
+        if (!theme.loadXml(&themeFile)) {
+            if (error) *error = QLatin1String("Unable to parse theme xml file: %1").arg(themeFile.fileName());
+            return -2;
+        }
+        themeFile.close();
+    }
+    return 0;
+}
 
-    loadKeys(part, wNode);
+int ThemeLoader::loadLayout(const QString& themeName, const QString& path)
+{
+    TRACE_SPAN("ThemeLoader::loadLayout");
+
+    ThemeData data;
+    QString error;
+    int ret = readTheme(themeName, path, data, &error);
+    if (ret != 0) {
+        QMessageBox::information(nullptr, QLatin1String("Error"), error);
+        return ret;
+    }
 
-    wList = wNode.childNodes();
+    buildLayout(data);
+    return 0;
+}
 
-    for (int a=0; a<wList.size(); a++) {
+void ThemeLoader::buildLayout(const ThemeData& data)
+{
+    TRACE_SPAN("ThemeLoader::buildLayout");
+    theme = data;
 
-        QDomNode wNode = wList.at(a);
-        if (wNode.toElement().tagName() == QLatin1String("extension")) {
-            MainWidget *widget1 = new MainWidget((QWidget*)parent());
-            widget1->setProperty("part", QLatin1String("extension"));
-            loadKeys(widget1, wNode);
-            break;
+    for (const ThemePart &part : std::as_const(theme.parts)) {
+        if (!deferredParts.contains(part.name)) {
+            loadKeys(createPart(part.name), part);
         }
     }
-    return 0;
 }
-bool ThemeLoader::applyProperty(VButton *btn, const QString& attributeName, QDomNamedNodeMap *attributes, QVariant defaultValue)
+
+MainWidget *ThemeLoader::loadPart(const QString& partName)
 {
-    bool ret = false;
+    if (!deferredParts.removeOne(partName)) return nullptr;
 
-    QString attributeValue = attributes->namedItem(attributeName).toAttr().value();
-    if (attributeValue.length()>0) {
-        btn->setProperty(qPrintable(attributeName), attributeValue);
-        ret = true;
-    }
-    else {
-        if (defaultValue.toString().length()>0) {
-            btn->setProperty(qPrintable(attributeName), defaultValue);
-            ret = true;
+    for (const ThemePart &part : std::as_const(theme.parts)) {
+        if (part.name == partName) {
+            MainWidget *vPart = createPart(part.name);
+            loadKeys(vPart, part);
+            return vPart;
         }
     }
-    return ret;
+    return nullptr;
 }
-void ThemeLoader::loadKeys(MainWidget *vPart, const QDomNode& wNode)
+VButton *ThemeLoader::createButton(MainWidget *vPart, const KeyDescriptor& key)
 {
-    int max_sx = 0;
-    int max_sy = 0;
+    VButton *btn = new VButton(vPart);
 
-    int sx = 0;
-    int sy = 0;
-    int rowMarginLeft = 0;
-    int rowSpacingY = 0;
-    int rowSpacingX = 0;
+    if (key.name.length()>0) {
+        btn->setObjectName(key.name);
+    }
 
-    int total_cols = 0;
-    int total_rows = 0;
+    if (key.label.length()>0) {
+        btn->setText(key.label);
+    }
 
-    QDomNodeList nList = wNode.childNodes();
+    if (key.colorGroup.length()>0) btn->setColorGroup(key.colorGroup);
+    if (key.tooltip.length()>0) btn->setProperty("tooltip", key.tooltip);
 
-    for (int a=0; a<nList.size(); a++) {
+    if (key.isModifier()) {
+        btn->setProperty("modifier", true);
+        btn->setCheckable(true);
+    }
 
-        QDomNode wNode = nList.at(a);
-        if (wNode.toElement().tagName() != QLatin1String("row")) continue;
+    if (key.keyCode>0) {
+        btn->setKeyCode(key.keyCode);
+    }
 
-        total_rows++;
+    if (key.action.length()>0) {
+        btn->setAction(key.action);
+    }
 
-        int rowHeight = defaultHeight;
+    if (key.flags & KeyDescriptor::Checkable) {
+        btn->setCheckable(true);
+        btn->setChecked(false);
+    }
 
-        int row_buttons = 0;
+    btn->move(key.rect.topLeft());
+    btn->resize(key.rect.size());
+    btn->storeSize();
 
-        QDomNodeList key_list = wNode.childNodes();
+    return btn;
+}
 
-        QString rowHeightHint = wNode.attributes().namedItem(QLatin1String("height")).toAttr().value();
-        if (heightMap.contains(rowHeightHint)) {
-            rowHeight = heightMap.value(rowHeightHint);
-        }
+MainWidget *ThemeLoader::createPart(const QString& partName)
+{
+    MainWidget *part = nullptr;
+    if (paintedKeys) {
+        part = new KeyboardSurface((QWidget*)parent());
+    }
+    else {
+        part = new MainWidget((QWidget*)parent());
+    }
+    part->setProperty("part", partName);
+    return part;
+}
 
-        for (int b=0; b<key_list.count(); b++) {
-            QDomNode node = key_list.at(b);
-            QDomNamedNodeMap attributes = node.attributes();
-
-            if (node.toElement().tagName()== QLatin1String("key")) {
-
-                VButton *btn = new VButton(vPart);
-                row_buttons++;
-
-                //width
-                int buttonWidth = defaultWidth;
-                int buttonHeight = defaultHeight;
-
-                QString widthHint = attributes.namedItem(QLatin1String("width")).toAttr().value();
-                if (widthMap.contains(widthHint)) {
-                    buttonWidth = widthMap.value(widthHint);
-                }
-
-                QString heightHint = attributes.namedItem(QLatin1String("height")).toAttr().value();
-                if (heightMap.contains(heightHint)) {
-                    buttonHeight = heightMap.value(heightHint);
-                }
-
-                //name
-                QString button_name = attributes.namedItem(QLatin1String("name")).toAttr().value();
-                if (button_name.length()>0) {
-                    btn->setObjectName(button_name);
-                }
-
-                if (applyProperty(btn, QLatin1String("label"), &attributes)) {
-                    btn->setText(btn->property("label").toString());
-                }
-
-                applyProperty(btn, QLatin1String("group_label"), &attributes);
-                applyProperty(btn, QLatin1String("group_toggle"), &attributes);
-                applyProperty(btn, QLatin1String("group_name"), &attributes);
-                applyProperty(btn, QLatin1String("colorGroup"), &attributes, QLatin1String("normal"));
-                applyProperty(btn, QLatin1String("tooltip"), &attributes);
-
-                QString modifier = attributes.namedItem(QLatin1String("modifier")).toAttr().value();
-                if (modifier.toInt()>0) {
-                    btn->setProperty("modifier", true);
-                    btn->setCheckable(true);
-                }
-
-                unsigned int key_code = attributes.namedItem(QLatin1String("code")).toAttr().value().toInt();
-                if (key_code>0) {
-                    btn->setKeyCode(key_code);
-                }
-
-                if (applyProperty(btn, QLatin1String("action"), &attributes)) {
-                    btn->setProperty("action", btn->property("action").toString());
-                }
-
-                int is_checkable = attributes.namedItem(QLatin1String("checkable")).toAttr().value().toInt();
-                if (is_checkable>0) {
-                    btn->setCheckable(true);
-                    btn->setChecked(false);
-                }
-
-                btn->move(sx,sy);
-                btn->resize(buttonWidth, buttonHeight);
-                btn->storeSize();
-
-                sx += buttonWidth+rowSpacingX;
-
-                Q_EMIT buttonLoaded(btn);
-            }
-            else if (node.toElement().tagName()==QLatin1String("spacing")) {
-
-                QString widthHint = attributes.namedItem(QLatin1String("width")).toAttr().value();
-                QString heightHint = attributes.namedItem(QLatin1String("height")).toAttr().value();
-
-                if (spacingMap.contains(widthHint)) {
-                    int spacingWidth = spacingMap.value(widthHint);
-                    sx += spacingWidth;
-                }
-                if (heightMap.contains(heightHint)) {
-                    int spacingHeight = heightMap.value(heightHint);
-                    if (spacingHeight>rowHeight) rowHeight = spacingHeight;
-                }
-            }
-        }//row
-
-        if (sx>max_sx) max_sx = sx;
-
-        sy+=(rowHeight+rowSpacingY);
-        sx=0+rowMarginLeft;
-
-        if (row_buttons>total_cols) total_cols=row_buttons;
+void ThemeLoader::loadKeys(MainWidget *vPart, const ThemePart& part)
+{
+    TRACE_SPAN("ThemeLoader::loadKeys");
+    KeyboardSurface *surface = qobject_cast<KeyboardSurface*>(vPart);
 
+    for (const KeyDescriptor &key : part.keys) {
+        if (surface) {
+            surface->addKey(key);
+        }
+        else {
+            VButton *btn = createButton(vPart, key);
+            vPart->addButton(btn, key);
+            Q_EMIT buttonLoaded(btn);
+        }
     }
-    if (sy>max_sy) max_sy = sy;
-
-    vPart->setBaseSize(max_sx, max_sy);
 
-    Q_EMIT partLoaded(vPart, total_rows, total_cols);
+    vPart->setBaseSize(part.baseSize.width(), part.baseSize.height());
 
+    Q_EMIT partLoaded(vPart, part.rows, part.columns);
 }
@@ -22,13 +22,13 @@
 #define THEMELOADER_H
 
 #include <QObject>
-#include <QDomNode>
-#include <QDomNamedNodeMap>
 #include <QVariant>
-#include <QMap>
 #include <QMenu>
 
+#include "colorstyle.h"
+#include "keydescriptor.h"
 #include "mainwidget.h"
+#include "themedata.h"
 #include "vbutton.h"
 
 class ThemeLoader : public QObject
@@ -39,18 +39,74 @@ public:
     ThemeLoader(QWidget *parent);
     ~ThemeLoader();
 
+    //load parts as a single painted KeyboardSurface instead of VButtons
+    void setPaintedKeys(bool painted);
+
+    //apply color files as Qt stylesheets instead of the compiled ColorStyle
+    void setStyleSheets(bool enabled);
+
+    //parts of the theme left out by loadLayout until loadPart asks for them
+    void setDeferredParts(const QStringList& partNames);
+
     void loadTheme(QString& themeName);
     void loadColorFile(const QString& fileName);
     int loadLayout(const QString& themeName, const QString& path);
+
+    /**
+     * Reads a theme without building anything, safe to call from any
+     * thread.
+     *
+     * @return 0 on success, negative with @p error set otherwise
+     */
+    static int readTheme(const QString& themeName, const QString& path, ThemeData& theme, QString *error);
+
+    /**
+     * Builds the parts of a theme read by readTheme.
+     */
+    void buildLayout(const ThemeData& data);
+
+    /**
+     * Applies a color style parsed elsewhere, loaded from @p fileName.
+     */
+    void applyColorStyle(const ColorStyle& style, const QString& fileName);
+    bool usesStyleSheets() const;
+
+    /**
+     * @return the color file to load for the configured @p selectedStyle
+     */
+    static QString selectedColorFile(const QString& selectedStyle);
+
+    /**
+     * Builds a part of the loaded theme that was deferred.
+     *
+     * @return the part, nullptr if the theme has no such deferred part
+     */
+    MainWidget *loadPart(const QString& partName);
+
+    /**
+     * Applies the configured color style, or the default one, without
+     * building the color menu.
+     */
+    void loadSelectedColorStyle(const QString& selectedStyle);
     void findColorStyles(QMenu *parent, const QString& selectedStyle);
 
 protected:
-    void loadKeys(MainWidget *vPart, const QDomNode& wNode);
-    bool applyProperty(VButton *btn, const QString& attributeName, QDomNamedNodeMap *attributes, QVariant defaultValue = QString{});
+    /**
+     * Loads the compiled form of a theme, built into the resources next to
+     * its XML under @p path, so it always matches the XML shipped with it.
+     */
+    static bool loadCompiledTheme(const QString& themeName, const QString& path, ThemeData& theme);
+    void loadKeys(MainWidget *vPart, const ThemePart& part);
+    MainWidget *createPart(const QString& partName);
+    VButton *createButton(MainWidget *vPart, const KeyDescriptor& key);
+
+    bool paintedKeys;
+    bool styleSheets;
+    ColorStyle colorStyle;
 
-    QMap<QString, int> widthMap;
-    QMap<QString, int> heightMap;
-    QMap<QString, int> spacingMap;
+    //the loaded theme, kept for its deferred parts
+    ThemeData theme;
+    QStringList deferredParts;
 
 public Q_SLOTS:
     void loadColorStyle();
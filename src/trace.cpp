@@ -0,0 +1,105 @@
+// Class Trace: scoped timeline spans exported as Chrome trace JSON
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+
+bool Trace::s_enabled = false;
+QString Trace::s_fileName;
+QMutex Trace::s_mutex;
+QVector<Trace::Event> Trace::s_events;
+
+static QElapsedTimer s_clock;
+
+void Trace::start(const QString& fileName)
+{
+    QMutexLocker locker(&s_mutex);
+
+    s_fileName = fileName;
+    s_events.reserve(256);
+    s_clock.start();
+    s_enabled = true;
+}
+
+bool Trace::isEnabled()
+{
+    return s_enabled;
+}
+
+qint64 Trace::now()
+{
+    return s_clock.nsecsElapsed();
+}
+
+void Trace::span(const char *name, qint64 beginNs, qint64 endNs)
+{
+    append(name, beginNs, endNs - beginNs);
+}
+
+void Trace::instant(const char *name)
+{
+    if (!s_enabled) return;
+    append(name, now(), -1);
+}
+
+void Trace::append(const char *name, qint64 beginNs, qint64 durationNs)
+{
+    Event event;
+    event.name = name;
+    event.beginNs = beginNs;
+    event.durationNs = durationNs;
+    event.thread = (quint64)(quintptr)QThread::currentThreadId();
+
+    QMutexLocker locker(&s_mutex);
+    s_events.append(event);
+}
+
+bool Trace::write()
+{
+    QMutexLocker locker(&s_mutex);
+    if (!s_enabled) return false;
+
+    QFile file(s_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Trace: unable to write" << s_fileName;
+        return false;
+    }
+
+    // Chrome wants small thread ids, number them in order of appearance
+    QVector<quint64> threads;
+    qint64 pid = QCoreApplication::applicationPid();
+
+    QByteArray json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int a = 0; a < s_events.size(); a++) {
+        const Event &event = s_events.at(a);
+
+        int tid = threads.indexOf(event.thread);
+        if (tid < 0) {
+            tid = threads.size();
+            threads << event.thread;
+        }
+
+        json += "{\"name\":\"";
+        json += event.name;
+        json += "\",\"cat\":\"kvkbd\",\"pid\":" + QByteArray::number(pid);
+        json += ",\"tid\":" + QByteArray::number(tid);
+        json += ",\"ts\":" + QByteArray::number(event.beginNs / 1000.0, 'f', 3);
+        if (event.durationNs >= 0) {
+            json += ",\"ph\":\"X\",\"dur\":" + QByteArray::number(event.durationNs / 1000.0, 'f', 3);
+        }
+        else {
+            json += ",\"ph\":\"i\",\"s\":\"t\"";
+        }
+        json += a + 1 < s_events.size() ? "},\n" : "}\n";
+    }
+    json += "]}\n";
+
+    return file.write(json) == json.size();
+}
@@ -0,0 +1,96 @@
+// Class Trace: scoped timeline spans exported as Chrome trace JSON
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Timeline instrumentation, built only with the KVKBD_TRACING CMake
+ * option. Without it the macros below expand to nothing.
+ *
+ * TRACE_SPAN("name") records the time until the end of the enclosing
+ * scope, TRACE_INSTANT("name") a single point in time. Names must be
+ * string literals. Recording starts with Trace::start(), from the
+ * --trace option or the KVKBD_TRACE environment variable, and
+ * Trace::write() saves what was recorded in the Trace Event Format read
+ * by chrome://tracing and Perfetto.
+ */
+
+#ifdef KVKBD_TRACING
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+class Trace
+{
+public:
+    /**
+     * Enables recording, @p fileName is where write() saves the trace.
+     */
+    static void start(const QString& fileName);
+    static bool isEnabled();
+
+    /**
+     * @return ns since start(), on the clock spans are recorded with
+     */
+    static qint64 now();
+
+    static void span(const char *name, qint64 beginNs, qint64 endNs);
+    static void instant(const char *name);
+
+    /**
+     * Saves all events recorded so far, replacing the file.
+     */
+    static bool write();
+
+protected:
+    struct Event {
+        const char *name;
+        qint64 beginNs;
+        //-1 for an instant
+        qint64 durationNs;
+        quint64 thread;
+    };
+
+    static void append(const char *name, qint64 beginNs, qint64 durationNs);
+
+    static bool s_enabled;
+    static QString s_fileName;
+    static QMutex s_mutex;
+    static QVector<Event> s_events;
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name) : name(name), begin(Trace::isEnabled() ? Trace::now() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (begin >= 0) {
+            Trace::span(name, begin, Trace::now());
+        }
+    }
+
+private:
+    const char *name;
+    qint64 begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_INSTANT(name) Trace::instant(name)
+
+#else
+
+#define TRACE_SPAN(name) do { } while (0)
+#define TRACE_INSTANT(name) do { } while (0)
+
+#endif // KVKBD_TRACING
+
+#endif // TRACE_H
@@ -1,10 +1,13 @@
 #include "vbutton.h"
+#include "colorstyle.h"
+#include "metrics.h"
 
 #define TIMER_INTERVAL_SHORT 40
 #define TIMER_INTERVAL_LONG  200
 
 int VButton::RepeatShortDelay = TIMER_INTERVAL_SHORT;
 int VButton::RepeatLongDelay = TIMER_INTERVAL_LONG;
+bool VButton::ServerRepeat = false;
 
 
 VButton::VButton(QWidget *parent) :
@@ -12,11 +15,15 @@ VButton::VButton(QWidget *parent) :
 {
     setFocusPolicy(Qt::NoFocus);
     setAttribute(Qt::WA_AlwaysShowToolTips);
+    setAttribute(Qt::WA_Hover);
 
     keyCode = 0;
     rightClicked = false;
+    keyHeld = false;
     mTextIndex = 0;
     isCaps = false;
+    styleKey = 0;
+    styleSerial = 0;
 
     keyTimer = new QTimer(this);
 
@@ -53,6 +60,20 @@ ButtonText VButton::buttonText() const
     return this->mButtonText;
 }
 
+void VButton::setColorGroup(const QString& colorGroup)
+{
+    mColorGroup = colorGroup;
+    styleSerial = 0;
+    setProperty("colorGroup", colorGroup);
+}
+
+void VButton::setAction(const QString& action)
+{
+    mAction = action;
+    styleSerial = 0;
+    setProperty("action", action);
+}
+
 void VButton::setTextIndex(int index)
 {
     this->mTextIndex = index;
@@ -114,18 +135,27 @@ void VButton::updateText()
 
 void VButton::sendKey()
 {
+    Metrics::keyEmitted();
     Q_EMIT keyClick(this->keyCode);
 }
 
 void VButton::mousePressEvent(QMouseEvent *e)
 {
+    Metrics::inputStarted();
     QPushButton::mousePressEvent(e);
     rightClicked = false;
     if (e->button() == Qt::RightButton) {
         rightClicked = true;
     }
 
-    if (this->keyCode>0) {
+    if (this->keyCode>0 && ServerRepeat && !isCheckable()) {
+        if (!keyHeld) {
+            keyHeld = true;
+            Metrics::keyEmitted();
+            Q_EMIT keyDown(this->keyCode);
+        }
+    }
+    else if (this->keyCode>0) {
         sendKey();
 
         if (!isCheckable()) {
@@ -140,9 +170,35 @@ void VButton::mousePressEvent(QMouseEvent *e)
 void VButton::mouseReleaseEvent(QMouseEvent *e)
 {
     if (keyTimer->isActive())keyTimer->stop();
+    if (keyHeld) {
+        keyHeld = false;
+        Q_EMIT keyUp(this->keyCode);
+    }
     QPushButton::mouseReleaseEvent(e);
 }
 
+void VButton::paintEvent(QPaintEvent *e)
+{
+    const ColorStyle *colors = ColorStyle::active();
+    if (!colors) {
+        QPushButton::paintEvent(e);
+        return;
+    }
+
+    int state = 0;
+    if (isDown()) state |= ColorStyle::Pressed;
+    if (isChecked()) state |= ColorStyle::Checked;
+    if (underMouse()) state |= ColorStyle::Hover;
+
+    if (colors->serial() != styleSerial) {
+        styleKey = colors->styleKey(mColorGroup, mAction);
+        styleSerial = colors->serial();
+    }
+
+    QPainter painter(this);
+    ColorStyle::paintKey(&painter, rect(), colors->keyStyle(styleKey, state), text());
+}
+
 void VButton::repeatKey()
 {
     //if the user is still pressing the button after 200 ms, we assume
@@ -36,8 +36,26 @@ public:
     void setCaps(bool mode);
     void setShift(bool mode);
 
+    /**
+     * Set once at creation. Also stored as the colorGroup and action
+     * properties the color stylesheets select on.
+     */
+    void setColorGroup(const QString& colorGroup);
+    void setAction(const QString& action);
+
+    static int RepeatShortDelay;
+    static int RepeatLongDelay;
+
+    /**
+     * When set, keys send keyDown on press and keyUp on release instead
+     * of repeated keyClick, and the X server autorepeat repeats them.
+     */
+    static bool ServerRepeat;
+
 Q_SIGNALS:
     void keyClick(unsigned int);
+    void keyDown(unsigned int);
+    void keyUp(unsigned int);
     void buttonAction(const QString& action);
 
 public Q_SLOTS:
@@ -48,6 +66,7 @@ protected:
     QRect vpos;
 
     bool rightClicked;
+    bool keyHeld;
     QTimer *keyTimer;
 
     ButtonText mButtonText;
@@ -56,12 +75,16 @@ protected:
     bool isCaps;
     bool isShift;
 
-    static int RepeatShortDelay;
-    static int RepeatLongDelay;
+    QString mColorGroup;
+    QString mAction;
+    //ColorStyle::styleKey of the above, for the style with styleSerial
+    int styleKey;
+    quint64 styleSerial;
 
 protected Q_SLOTS:
     void mousePressEvent(QMouseEvent *e) override;
     void mouseReleaseEvent(QMouseEvent *e) override;
+    void paintEvent(QPaintEvent *e) override;
     void repeatKey();
 };
 
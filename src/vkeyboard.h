@@ -43,17 +43,43 @@ public:
 
     virtual void textForKeyCode(unsigned int keyCode, ButtonText& text)=0;
 
+    //server side delay between injected key events, in ms
+    virtual void setKeyEventDelay(unsigned long delay)=0;
+
+    //key codes of the modifiers held down until the latch ends
+    virtual void setLatchedModifiers(const QList<unsigned int>& keyCodes)=0;
+
+    //when not sticky, the next key sent ends the latch
+    virtual void setStickyModifiers(bool sticky)=0;
+
+    //number of key events injected so far
+    virtual quint64 injectedEvents() const=0;
+
+    //types text as key presses, returns the number of characters typed
+    virtual int typeText(const QString& text)=0;
+
 public Q_SLOTS:
     virtual void processKeyPress(unsigned int)=0;
+
+    //press and release sent apart, the server repeats the key in between
+    virtual void processKeyDown(unsigned int)=0;
+    virtual void processKeyUp(unsigned int)=0;
+
     virtual void queryModState()=0;
     virtual void constructLayouts()=0;
     virtual void layoutChanged()=0;
     virtual void start()=0;
 
+    //emits the current layout and group state again, for parts built later
+    virtual void resendState()=0;
+
 Q_SIGNALS:
-    //key sent successfully
+    //key sent successfully, for feedback only
     void keyProcessComplete(unsigned int);
 
+    //the latch ended with a key, the modifiers are released already
+    void modifiersReleased();
+
     void groupStateChanged(const ModifierGroupStateMap& modifier_state);
 
     //layout index in list, layout caption
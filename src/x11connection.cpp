@@ -0,0 +1,111 @@
+// Class X11Connection: process-wide Xlib display connection
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "x11connection.h"
+
+#include <QDebug>
+#include <QGuiApplication>
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+#include <QX11Info>
+#endif
+
+#include <X11/Xlib.h>
+
+Display *X11Connection::s_display = nullptr;
+bool X11Connection::s_shared = false;
+bool X11Connection::s_lost = false;
+QAtomicInteger<quint64> X11Connection::s_openCount(0);
+
+static Display *qtDisplay()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    if (qGuiApp) {
+        if (auto *x11App = qGuiApp->nativeInterface<QNativeInterface::QX11Application>()) {
+            return x11App->display();
+        }
+    }
+    return nullptr;
+#else
+    if (qGuiApp && QX11Info::isPlatformX11()) {
+        return QX11Info::display();
+    }
+    return nullptr;
+#endif
+}
+
+Display *X11Connection::display()
+{
+    if (s_display && !s_lost) {
+        return s_display;
+    }
+
+    if (s_lost) {
+        qWarning() << "X11Connection: connection to the X server lost, reconnecting";
+        XCloseDisplay(s_display);
+        s_display = nullptr;
+        s_lost = false;
+    }
+
+    s_display = qtDisplay();
+    if (s_display) {
+        s_shared = true;
+        return s_display;
+    }
+
+    s_shared = false;
+    s_display = XOpenDisplay(nullptr);
+    if (!s_display) {
+        return nullptr;
+    }
+    s_openCount.ref();
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+    // Keep running when the server goes away, display() reconnects later
+    XSetIOErrorExitHandler(s_display, &X11Connection::connectionLost, nullptr);
+#endif
+
+    return s_display;
+}
+
+bool X11Connection::isShared()
+{
+    return s_shared;
+}
+
+quint64 X11Connection::openCount()
+{
+    return s_openCount.loadAcquire();
+}
+
+void X11Connection::release()
+{
+    if (s_display && !s_shared) {
+        XCloseDisplay(s_display);
+    }
+    s_display = nullptr;
+    s_shared = false;
+    s_lost = false;
+}
+
+Display *X11Connection::openPrivate()
+{
+    Display *display = XOpenDisplay(nullptr);
+    if (display) {
+        s_openCount.ref();
+    }
+    return display;
+}
+
+void X11Connection::closePrivate(Display *display)
+{
+    if (display) {
+        XCloseDisplay(display);
+    }
+}
+
+void X11Connection::connectionLost(Display *, void *)
+{
+    s_lost = true;
+}
@@ -0,0 +1,58 @@
+// Class X11Connection: process-wide Xlib display connection
+// SPDX-FileCopyrightText: Copyright (C) 2026 Kvkbd Developers
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef X11CONNECTION_H
+#define X11CONNECTION_H
+
+#include <QAtomicInteger>
+
+typedef struct _XDisplay Display;
+
+/**
+ * Class X11Connection:
+ * Owns the single display connection used by every X call site of kvkbd.
+ * The connection Qt opened for its xcb platform plugin is reused when
+ * available, otherwise one private connection is opened on first use and
+ * kept open until release(). A private connection that is lost because the
+ * server reset is reopened transparently on the next call to display().
+ */
+class X11Connection
+{
+public:
+    /**
+     * @return the shared display, or nullptr if the X server is unreachable
+     */
+    static Display *display();
+
+    /**
+     * @return true if display() returns the connection owned by Qt
+     */
+    static bool isShared();
+
+    /**
+     * @return the number of XOpenDisplay calls made since startup
+     */
+    static quint64 openCount();
+
+    /**
+     * Closes the private connection, if any.
+     */
+    static void release();
+
+    /**
+     * Opens an additional connection for use by a single worker thread.
+     */
+    static Display *openPrivate();
+    static void closePrivate(Display *display);
+
+private:
+    static void connectionLost(Display *display, void *userData);
+
+    static Display *s_display;
+    static bool s_shared;
+    static bool s_lost;
+    static QAtomicInteger<quint64> s_openCount;
+};
+
+#endif // X11CONNECTION_H
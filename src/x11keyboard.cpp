@@ -20,12 +20,17 @@
 
 #include "x11keyboard.h"
 
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
 #include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
 #include <QDataStream>
-#include <QDBusInterface>
-#include <QDBusReply>
+#include <QDebug>
+#include <QSocketNotifier>
+#include <QTimer>
 
-#include <X11/extensions/XTest.h>
 #include <X11/Xlocale.h>
 #include <X11/Xos.h>
 #include <X11/Xlib.h>
@@ -33,14 +38,62 @@
 #include <X11/Xproto.h>
 
 #include <X11/XKBlib.h>
+#include <X11/extensions/XKBproto.h>
 
-#include "vbutton.h"
-extern QList<VButton *> modKeys;
+#include "metrics.h"
+#include "trace.h"
+#include "x11connection.h"
 
-#include "kbdlayout.h"
+//spare key codes kept remapped for typeText
+#define SCRATCH_KEY_COUNT 8
+//strokes kept while the injection queue is full before taps are dropped
+#define OVERFLOW_LIMIT 1024
 
-X11Keyboard::X11Keyboard(QObject *parent): VKeyboard(parent)
+//the control characters typeText types as their function keys
+static unsigned long controlKeySym(unsigned int ucs)
 {
+    switch (ucs) {
+    case '\n':
+    case '\r':
+        return XK_Return;
+    case '\t':
+        return XK_Tab;
+    case '\b':
+        return XK_BackSpace;
+    case 0x1b:
+        return XK_Escape;
+    }
+    return NoSymbol;
+}
+
+//records the round trip of an asynchronous call on the startup timeline
+static void traceCall(const char *name, QDBusPendingCallWatcher *watcher)
+{
+#ifdef KVKBD_TRACING
+    qint64 begin = watcher->property("traceBegin").toLongLong();
+    if (begin >= 0) {
+        Trace::span(name, begin, Trace::now());
+    }
+#else
+    Q_UNUSED(name);
+    Q_UNUSED(watcher);
+#endif
+}
+
+static QDBusMessage keyboardLayoutsCall(const QString& method)
+{
+    return QDBusMessage::createMethodCall(QLatin1String("org.kde.keyboard"), QLatin1String("/Layouts"),
+                                          QLatin1String("org.kde.KeyboardLayouts"), method);
+}
+
+X11Keyboard::X11Keyboard(QObject *parent): VKeyboard(parent),
+    layout_index(0), layoutSerial(0), injection(nullptr), stickyModifiers(false),
+    keymapTimer(nullptr), overflowTimer(nullptr), droppedStrokes(0),
+    scratchInitialized(false), scratchClock(0), xkbGroup(0),
+    xkbEventBase(-1), capsLockMask(LockMask), numLockMask(0),
+    capsLockIndicator(-1), numLockIndicator(-1), xkbNotifier(nullptr)
+{
+    TRACE_SPAN("X11Keyboard::X11Keyboard");
     KbdLayout::registerMetaType();
     QString service = QLatin1String("");
     QString path = QLatin1String("/Layouts");
@@ -48,170 +101,578 @@ X11Keyboard::X11Keyboard(QObject *parent): VKeyboard(parent)
 
     QDBusConnection session = QDBusConnection::sessionBus();
 
-    session.connect(service, path, interface, QLatin1String("layoutChanged"), this, SLOT(layoutChanged()));
+    session.connect(service, path, interface, QLatin1String("layoutChanged"), this, SLOT(layoutIndexChanged(uint)));
     session.connect(service, path, interface, QLatin1String("layoutListChanged"), this, SLOT(constructLayouts()));
 
     constructLayouts();
-    groupTimer = new QTimer(parent);
-    groupTimer->setInterval(250);
 
-    groupState.insert(QLatin1String("capslock"), this->queryModKeyState(XK_Caps_Lock));
-    groupState.insert(QLatin1String("numlock"), this->queryModKeyState(XK_Num_Lock));
+    groupState.insert(QLatin1String("capslock"), false);
+    groupState.insert(QLatin1String("numlock"), false);
+
+    // Keymap changes arrive as bursts of XKB events, rebuild once per burst
+    keymapTimer = new QTimer(this);
+    keymapTimer->setSingleShot(true);
+    keymapTimer->setInterval(0);
+    connect(keymapTimer, SIGNAL(timeout()), this, SLOT(rebuildKeymap()));
 
-    connect(groupTimer, SIGNAL(timeout()), this, SLOT(queryModState()));
+    selectXkbEvents();
+    queryModState();
+
+    // Retries the strokes the injection queue had no room for
+    overflowTimer = new QTimer(this);
+    overflowTimer->setSingleShot(true);
+    overflowTimer->setInterval(1);
+    connect(overflowTimer, SIGNAL(timeout()), this, SLOT(flushOverflow()));
+
+    injection = new InjectionThread(this);
+    connect(injection, SIGNAL(keySent(unsigned int)), this, SIGNAL(keyProcessComplete(unsigned int)), Qt::QueuedConnection);
+    injection->start();
 }
 
 X11Keyboard::~X11Keyboard()
 {
+    // Ending a latch here must not reach back into the application
+    blockSignals(true);
+
+    //never leave a key down on the server
+    const QList<unsigned int> held = heldKeys.values();
+    for (unsigned int keyCode : held) {
+        processKeyUp(keyCode);
+    }
+    setLatchedModifiers(QList<unsigned int>());
+    restoreScratchKeys();
+
+    // The event loop is gone, hand over the rest before the worker ends
+    while (!overflow.isEmpty()) {
+        flushOverflow();
+        QThread::yieldCurrentThread();
+    }
+    injection->stop();
+
+    if (QCoreApplication::instance()) {
+        QCoreApplication::instance()->removeNativeEventFilter(this);
+    }
 }
 
 void X11Keyboard::start()
 {
+    // Paint with what is known now, the D-Bus replies relabel later
+    resendState();
     layoutChanged();
+}
+
+void X11Keyboard::resendState()
+{
+    Q_EMIT layoutUpdated(layout_index, layoutCaption());
     Q_EMIT groupStateChanged(groupState);
-    groupTimer->start();
 }
 
-void X11Keyboard::constructLayouts()
+void X11Keyboard::selectXkbEvents()
 {
-    QDBusInterface iface(QLatin1String("org.kde.keyboard"), QLatin1String("/Layouts"), QLatin1String("org.kde.KeyboardLayouts"), QDBusConnection::sessionBus());
+    Display *display = X11Connection::display();
+    if (!display) return;
+
+    int opcode, errorBase;
+    int major = XkbMajorVersion;
+    int minor = XkbMinorVersion;
+    if (!XkbQueryExtension(display, &opcode, &xkbEventBase, &errorBase, &major, &minor)) {
+        qWarning() << "X11Keyboard: XKB extension not available, lock state will not be tracked";
+        xkbEventBase = -1;
+        return;
+    }
+
+    // Only add our details, the shared connection may have selected others for Qt
+    unsigned int stateDetails = XkbModifierLockMask | XkbGroupStateMask;
+    XkbSelectEventDetails(display, XkbUseCoreKbd, XkbStateNotify, stateDetails, stateDetails);
+    XkbSelectEventDetails(display, XkbUseCoreKbd, XkbIndicatorStateNotify, XkbAllIndicatorsMask, XkbAllIndicatorsMask);
+    XkbSelectEventDetails(display, XkbUseCoreKbd, XkbNewKeyboardNotify, XkbNKN_KeycodesMask, XkbNKN_KeycodesMask);
+    XkbSelectEventDetails(display, XkbUseCoreKbd, XkbMapNotify, XkbAllClientInfoMask, XkbAllClientInfoMask);
+    XFlush(display);
+
+    keymap.rebuild(display);
+    updateKeymapMasks();
 
-    QDBusReply<QList<KbdLayout>> reply = iface.call(QLatin1String("getLayoutsList"));
-    if (reply.isValid()) {
+    if (X11Connection::isShared()) {
+        // Qt reads the connection, XKB events reach us through the native event filter
+        QCoreApplication::instance()->installNativeEventFilter(this);
+    } else {
+        xkbNotifier = new QSocketNotifier(ConnectionNumber(display), QSocketNotifier::Read, this);
+        connect(xkbNotifier, &QSocketNotifier::activated, this, &X11Keyboard::readXkbEvents);
+
+        // Events read into the Xlib queue by a round trip do not wake the notifier
+        connect(QAbstractEventDispatcher::instance(), &QAbstractEventDispatcher::aboutToBlock, this, [this]() {
+            Display *display = X11Connection::display();
+            if (display && XEventsQueued(display, QueuedAlready) > 0) {
+                readXkbEvents();
+            }
+        });
+    }
+}
 
-        QList<KbdLayout> lst = reply.value();
-        layouts.clear();
+void X11Keyboard::updateKeymapMasks()
+{
+    Display *display = X11Connection::display();
+    if (!display) return;
 
-        QListIterator<KbdLayout> itr(lst);
+    numLockMask = keymap.modifiersForKeySym(XK_Num_Lock);
 
-        while (itr.hasNext()) {
-            QString layout_name = itr.next().shortName();
-            layouts << layout_name;
-        }
+    Bool state;
+    if (!XkbGetNamedIndicator(display, XInternAtom(display, "Caps Lock", False), &capsLockIndicator, &state, nullptr, nullptr)) {
+        capsLockIndicator = -1;
+    }
+    if (!XkbGetNamedIndicator(display, XInternAtom(display, "Num Lock", False), &numLockIndicator, &state, nullptr, nullptr)) {
+        numLockIndicator = -1;
     }
 }
 
-void X11Keyboard::processKeyPress(unsigned int keyCode)
+void X11Keyboard::rebuildKeymap()
 {
-    groupTimer->stop();
-    sendKey(keyCode);
-    Q_EMIT keyProcessComplete(keyCode);
-    groupTimer->start();
+    TRACE_SPAN("X11Keyboard::rebuildKeymap");
+    if (!keymap.rebuild(X11Connection::display())) return;
+
+    updateKeymapMasks();
+    Q_EMIT layoutUpdated(layout_index, layoutCaption());
 }
 
-void X11Keyboard::sendKey(unsigned int keycode)
+bool X11Keyboard::nativeEventFilter(const QByteArray &eventType, void *message, NativeEventResult *)
 {
-    Window currentFocus;
-    int revertTo;
+    if (xkbEventBase < 0 || eventType != "xcb_generic_event_t") return false;
 
-    Display *display = XOpenDisplay(nullptr);
-    XGetInputFocus(display, &currentFocus, &revertTo);
+    const xkbAnyEvent *event = static_cast<const xkbAnyEvent *>(message);
+    if ((event->type & 0x7f) != xkbEventBase) return false;
 
-    QListIterator<VButton *> itr(modKeys);
-    while (itr.hasNext()) {
-        VButton *mod = itr.next();
-        if (mod->isChecked()) {
-            XTestFakeKeyEvent(display, mod->getKeyCode(), true, 2);
-        }
+    switch (event->xkbType) {
+    case XkbStateNotify: {
+        const xkbStateNotify *stateEvent = reinterpret_cast<const xkbStateNotify *>(event);
+        updateLockState(stateEvent->lockedMods);
+        updateGroup(stateEvent->group);
+        break;
+    }
+    case XkbIndicatorStateNotify:
+        updateIndicatorState(reinterpret_cast<const xkbIndicatorNotify *>(event)->state);
+        break;
+    case XkbNewKeyboardNotify:
+    case XkbMapNotify:
+        keymapTimer->start();
+        break;
     }
 
-    XTestFakeKeyEvent(display, keycode, true, 2);
-    XTestFakeKeyEvent(display, keycode, false, 2);
+    // Qt needs the XKB events for its own keyboard state as well
+    return false;
+}
 
-    itr.toFront();
-    while (itr.hasNext()) {
-        VButton *mod = itr.next();
-        if (mod->isChecked()) {
-            XTestFakeKeyEvent(display, mod->getKeyCode(), false, 2);
+void X11Keyboard::readXkbEvents()
+{
+    Display *display = X11Connection::display();
+    if (!display) return;
+
+    while (XPending(display)) {
+        XkbEvent event;
+        XNextEvent(display, &event.core);
+        if (event.type != xkbEventBase) continue;
+
+        switch (event.any.xkb_type) {
+        case XkbStateNotify:
+            updateLockState(event.state.locked_mods);
+            updateGroup(event.state.group);
+            break;
+        case XkbIndicatorStateNotify:
+            updateIndicatorState(event.indicators.state);
+            break;
+        case XkbNewKeyboardNotify:
+        case XkbMapNotify:
+            keymapTimer->start();
+            break;
         }
     }
-    XFlush(display);
-    XCloseDisplay(display);
 }
 
-bool X11Keyboard::queryModKeyState(KeySym iKey)
+void X11Keyboard::updateLockState(unsigned int lockedMods)
 {
-    int          iKeyMask = 0;
-    Window       wDummy1, wDummy2;
-    int          iDummy3, iDummy4, iDummy5, iDummy6;
-    unsigned int iMask;
+    bool caps_state = (lockedMods & capsLockMask) != 0;
+    bool num_state = numLockMask != 0 && (lockedMods & numLockMask) != 0;
 
-    Display* display = XOpenDisplay(nullptr);
+    setGroupState(caps_state, num_state);
+}
 
-    XModifierKeymap* map = XGetModifierMapping(display);
-    KeyCode keyCode = XKeysymToKeycode(display, iKey);
-    if (keyCode == NoSymbol) return false;
-    for (int i = 0; i < 8; ++i) {
-        if (map->modifiermap[map->max_keypermod * i] == keyCode) {
-            iKeyMask = 1 << i;
-        }
-    }
-    XQueryPointer(display, DefaultRootWindow(display), &wDummy1, &wDummy2, &iDummy3, &iDummy4, &iDummy5, &iDummy6, &iMask);
-    XFreeModifiermap(map);
-    XCloseDisplay(display);
-    return ((iMask & iKeyMask) != 0);
+void X11Keyboard::updateGroup(int group)
+{
+    if (group == xkbGroup) return;
+
+    xkbGroup = group;
+    Q_EMIT layoutUpdated(layout_index, layoutCaption());
 }
 
-void X11Keyboard::queryModState()
+void X11Keyboard::updateIndicatorState(unsigned int indicators)
 {
+    bool caps_state = groupState.value(QLatin1String("capslock"));
+    bool num_state = groupState.value(QLatin1String("numlock"));
+
+    if (capsLockIndicator >= 0) {
+        caps_state = (indicators & (1u << capsLockIndicator)) != 0;
+    }
+    if (numLockIndicator >= 0) {
+        num_state = (indicators & (1u << numLockIndicator)) != 0;
+    }
 
-    bool curr_caps_state = this->queryModKeyState(XK_Caps_Lock);
-    bool curr_num_state = this->queryModKeyState(XK_Num_Lock);
+    setGroupState(caps_state, num_state);
+}
 
+void X11Keyboard::setGroupState(bool curr_caps_state, bool curr_num_state)
+{
     bool caps_state = groupState.value(QLatin1String("capslock"));
     bool num_state = groupState.value(QLatin1String("numlock"));
 
+    if (curr_caps_state == caps_state && curr_num_state == num_state) return;
+
     groupState.insert(QLatin1String("capslock"), curr_caps_state);
     groupState.insert(QLatin1String("numlock"), curr_num_state);
 
-    if (curr_caps_state != caps_state || curr_num_state != num_state) {
+    Q_EMIT groupStateChanged(groupState);
+}
 
-        Q_EMIT groupStateChanged(groupState);
-    }
+void X11Keyboard::constructLayouts()
+{
+    // Plain method call, a QDBusInterface would introspect synchronously first
+    QDBusPendingCall call = QDBusConnection::sessionBus().asyncCall(keyboardLayoutsCall(QLatin1String("getLayoutsList")));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+#ifdef KVKBD_TRACING
+    watcher->setProperty("traceBegin", Trace::isEnabled() ? Trace::now() : -1);
+#endif
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(layoutListReceived(QDBusPendingCallWatcher*)));
 }
 
-void X11Keyboard::layoutChanged()
+void X11Keyboard::layoutListReceived(QDBusPendingCallWatcher *watcher)
 {
-    //std::cerr << "LayoutChanged" << std::endl;
+    QDBusPendingReply<QList<KbdLayout>> reply = *watcher;
+    watcher->deleteLater();
+    traceCall("getLayoutsList", watcher);
 
-    QDBusInterface iface(QLatin1String("org.kde.keyboard"), QLatin1String("/Layouts"), QLatin1String("org.kde.KeyboardLayouts"), QDBusConnection::sessionBus());
+    if (reply.isError()) return;
 
-    QDBusReply<uint> reply = iface.call(QLatin1String("getLayout"));
+    layoutList = reply.value();
+    Q_EMIT layoutUpdated(layout_index, layoutCaption());
+}
 
-    if (reply.isValid()) {
-        layout_index = (int) reply.value();
-        Q_EMIT layoutUpdated(layout_index, layouts.at(layout_index));
-    } else {
-        layout_index = 0;
-        Q_EMIT layoutUpdated(0, QLatin1String("us"));
+void X11Keyboard::processKeyPress(unsigned int keyCode)
+{
+    // keyProcessComplete is emitted once the injection thread has sent the key
+    sendKey(keyCode, KeyStroke::Click);
+    endLatch();
+}
+
+void X11Keyboard::processKeyDown(unsigned int keyCode)
+{
+    if (heldKeys.contains(keyCode)) return;
+
+    heldKeys.insert(keyCode);
+    sendKey(keyCode, KeyStroke::Press);
+}
+
+void X11Keyboard::processKeyUp(unsigned int keyCode)
+{
+    if (!heldKeys.remove(keyCode)) return;
+
+    // keyProcessComplete is emitted once the release has been sent
+    sendKey(keyCode, KeyStroke::Release);
+    endLatch();
+}
+
+void X11Keyboard::endLatch()
+{
+    if (stickyModifiers || latchedModifiers.isEmpty()) return;
+
+    // Queued in order behind the key, before any key tapped after it
+    for (unsigned int keyCode : std::as_const(latchedModifiers)) {
+        sendKey(keyCode, KeyStroke::Unlatch);
     }
+    latchedModifiers.clear();
+
+    Q_EMIT modifiersReleased();
 }
-void X11Keyboard::textForKeyCode(unsigned int keyCode,  ButtonText& text)
+
+void X11Keyboard::sendKey(unsigned int keycode, int type)
 {
-    if (keyCode==0) {
-        text.clear();
+    qint64 inputAt = 0;
+    if (type == KeyStroke::Click || type == KeyStroke::Press) {
+        inputAt = Metrics::takeInput();
+    }
+
+    if (type == KeyStroke::Click && overflow.size() >= OVERFLOW_LIMIT) {
+        // A tap can be lost, a release or an unlatch never
+        droppedStrokes++;
+        qWarning() << "X11Keyboard: injection queue full, dropped key" << keycode << "(" << droppedStrokes << "dropped)";
         return;
     }
 
-    KeyCode button_code = keyCode;
+    queueStroke(keycode, type, NoSymbol, inputAt);
+}
 
-    Display *display = XOpenDisplay(nullptr);
+void X11Keyboard::queueStroke(unsigned int keyCode, int type, unsigned long keySym, qint64 inputAt)
+{
+    KeyStroke stroke;
+    stroke.keyCode = keyCode;
+    stroke.type = type;
+    stroke.keySym = keySym;
+    stroke.queuedAt = KeyInjector::now();
+    stroke.inputAt = inputAt;
+
+    // Never wait for the worker, strokes it has no room for yet are kept
+    // here, behind any kept earlier so the order is preserved
+    if (overflow.isEmpty() && injection->enqueue(stroke)) return;
+
+    overflow.append(stroke);
+    if (!overflowTimer->isActive()) {
+        overflowTimer->start();
+    }
+}
 
-    // layout_index cycles around the first four layouts on X11 (Plasma keyboard kcm can define more layouts)
-    KeySym normal = XkbKeycodeToKeysym( display, button_code, layout_index, 0);
-    KeySym shift  = XkbKeycodeToKeysym( display, button_code, layout_index, 1);
+void X11Keyboard::flushOverflow()
+{
+    int queued = 0;
+    while (queued < overflow.size() && injection->enqueue(overflow.at(queued))) {
+        queued++;
+    }
+    overflow.remove(0, queued);
 
-    long int ret = kconvert.convert(normal);
-    long int shiftRet = kconvert.convert(shift);
+    if (!overflow.isEmpty()) {
+        overflowTimer->start();
+    }
+}
 
-    QChar normalText = QChar((uint)ret);
-    QChar shiftText = QChar((uint)shiftRet);
+void X11Keyboard::setKeyEventDelay(unsigned long delay)
+{
+    injection->setEventDelay(delay);
+}
+
+int X11Keyboard::typeText(const QString& text)
+{
+    if (!keymap.isValid()) return 0;
+
+    const unsigned int shiftKey = keymap.keyCodeForKeySym(XK_Shift_L, xkbGroup);
+    const bool capsLock = groupState.value(QLatin1String("capslock"));
+
+    // The text is typed as given, latched modifiers are lifted around it
+    for (unsigned int keyCode : std::as_const(latchedModifiers)) {
+        queueStroke(keyCode, KeyStroke::Unlatch);
+    }
+
+    // Scratch keys typed since the last sync keep their mapping
+    quint64 syncedAt = scratchClock;
+    bool shiftDown = false;
+    int typed = 0;
+
+    const QVector<uint> codePoints = text.toUcs4();
+    for (uint ucs : codePoints) {
+        unsigned long keySym = controlKeySym(ucs);
+        unsigned int keyCode = 0;
+        int level = 0;
+
+        if (keySym != NoSymbol) {
+            keyCode = keymap.keyCodeForKeySym(keySym, xkbGroup);
+        }
+        else if (ucs < 0x20 || ucs == 0x7f) {
+            continue;
+        }
+        else {
+            keySym = kconvert.fromUcs(ucs);
+            if (keySym == NoSymbol) continue;
+
+            if (!keymap.findUcs(ucs, xkbGroup, &keyCode, &level) || isScratchKey(keyCode)) {
+                keyCode = 0;
+            }
+            else if (capsLock && level < 2 && QChar::toLower(ucs) != QChar::toUpper(ucs)) {
+                // Caps Lock swaps the levels of cased letters
+                level ^= 1;
+            }
+        }
+
+        if (keyCode == 0 || level > 1 || (level == 1 && shiftKey == 0)) {
+            int index = scratchKey(keySym, syncedAt);
+            if (index < 0 && syncedAt != scratchClock) {
+                // Every scratch key is taken by keys still on their way, let
+                // the server deliver them before any key is remapped
+                queueStroke(0, KeyStroke::Sync);
+                syncedAt = scratchClock;
+                index = scratchKey(keySym, syncedAt);
+            }
+            if (index < 0) continue;
+
+            if (scratchKeys.at(index).keySym != keySym) {
+                remapScratchKey(index, keySym);
+            }
+            keyCode = scratchKeys.at(index).keyCode;
+            level = 0;
+        }
+
+        bool needShift = level == 1;
+        if (needShift != shiftDown) {
+            queueStroke(shiftKey, needShift ? KeyStroke::Latch : KeyStroke::Unlatch);
+            shiftDown = needShift;
+        }
+        queueStroke(keyCode, KeyStroke::Click);
+        typed++;
+    }
+
+    if (shiftDown) {
+        queueStroke(shiftKey, KeyStroke::Unlatch);
+    }
+    for (unsigned int keyCode : std::as_const(latchedModifiers)) {
+        queueStroke(keyCode, KeyStroke::Latch);
+    }
+    return typed;
+}
+
+int X11Keyboard::scratchKey(unsigned long keySym, quint64 usedSince)
+{
+    if (!scratchInitialized) {
+        scratchInitialized = true;
+        // The highest key codes are the least likely to be claimed later
+        const QVector<unsigned int> spare = keymap.spareKeyCodes();
+        for (int a = spare.size() - 1; a >= 0 && scratchKeys.size() < SCRATCH_KEY_COUNT; a--) {
+            scratchKeys.append({spare.at(a), NoSymbol, 0});
+        }
+    }
+
+    int victim = -1;
+    for (int a = 0; a < scratchKeys.size(); a++) {
+        const ScratchKey &key = scratchKeys.at(a);
+        if (key.keySym == keySym) {
+            victim = a;
+            break;
+        }
+        // Clients may still translate the earlier use with the new mapping
+        if (key.lastUse > usedSince) continue;
+
+        if (victim < 0 || key.lastUse < scratchKeys.at(victim).lastUse) {
+            victim = a;
+        }
+    }
+
+    if (victim >= 0) {
+        scratchKeys[victim].lastUse = ++scratchClock;
+    }
+    return victim;
+}
+
+void X11Keyboard::remapScratchKey(int index, unsigned long keySym)
+{
+    // Remapped by the injection thread, in order with the queued keys
+    ScratchKey &key = scratchKeys[index];
+    queueStroke(key.keyCode, KeyStroke::Remap, keySym);
+    key.keySym = keySym;
+}
+
+bool X11Keyboard::isScratchKey(unsigned int keyCode) const
+{
+    for (const ScratchKey &key : scratchKeys) {
+        if (key.keyCode == keyCode) return true;
+    }
+    return false;
+}
+
+void X11Keyboard::restoreScratchKeys()
+{
+    for (int a = 0; a < scratchKeys.size(); a++) {
+        if (scratchKeys.at(a).keySym != NoSymbol) {
+            remapScratchKey(a, NoSymbol);
+        }
+    }
+}
+
+void X11Keyboard::setLatchedModifiers(const QList<unsigned int>& keyCodes)
+{
+    // Modifiers are pressed once when checked and released when the latch
+    // ends, keystrokes in between are a plain press and release
+    for (unsigned int keyCode : std::as_const(latchedModifiers)) {
+        if (!keyCodes.contains(keyCode)) {
+            sendKey(keyCode, KeyStroke::Unlatch);
+        }
+    }
+    for (unsigned int keyCode : keyCodes) {
+        if (!latchedModifiers.contains(keyCode)) {
+            sendKey(keyCode, KeyStroke::Latch);
+        }
+    }
+
+    latchedModifiers = keyCodes;
+}
 
-    //cout <<  "Normal Text " << normalText.toAscii() << " Shift Text: " << shiftText.toAscii() << std::endl;
+void X11Keyboard::setStickyModifiers(bool sticky)
+{
+    stickyModifiers = sticky;
+}
 
+quint64 X11Keyboard::injectedEvents() const
+{
+    return injection->eventCount();
+}
+
+void X11Keyboard::queryModState()
+{
+    Display *display = X11Connection::display();
+    if (!display) return;
+
+    XkbStateRec state;
+    if (XkbGetState(display, XkbUseCoreKbd, &state) == Success) {
+        updateLockState(state.locked_mods);
+        xkbGroup = state.group;
+    }
+}
+
+void X11Keyboard::layoutChanged()
+{
+    QDBusPendingCall call = QDBusConnection::sessionBus().asyncCall(keyboardLayoutsCall(QLatin1String("getLayout")));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+#ifdef KVKBD_TRACING
+    watcher->setProperty("traceBegin", Trace::isEnabled() ? Trace::now() : -1);
+#endif
+    watcher->setProperty("serial", layoutSerial);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(layoutIndexReceived(QDBusPendingCallWatcher*)));
+}
+
+void X11Keyboard::layoutIndexReceived(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<uint> reply = *watcher;
+    watcher->deleteLater();
+    traceCall("getLayout", watcher);
+
+    // A layoutChanged signal received meanwhile is more recent than this reply
+    if (reply.isError() || watcher->property("serial").toULongLong() != layoutSerial) return;
+
+    layoutIndexChanged(reply.value());
+}
+
+void X11Keyboard::layoutIndexChanged(uint index)
+{
+    layoutSerial++;
+
+    layout_index = (int) index;
+    Q_EMIT layoutUpdated(layout_index, layoutCaption());
+}
+
+QString X11Keyboard::layoutCaption() const
+{
+    if (layout_index >= 0 && layout_index < layoutList.size()) {
+        return layoutList.at(layout_index).shortName();
+    }
+
+    QString name = keymap.layoutName(xkbGroup);
+    return name.isEmpty() ? QLatin1String("us") : name;
+}
+void X11Keyboard::textForKeyCode(unsigned int keyCode,  ButtonText& text)
+{
     text.clear();
+
+    if (keyCode==0 || !keymap.isValid()) {
+        return;
+    }
+
+    // The effective XKB group, not the Plasma layout index: Plasma can define
+    // more layouts than the four XKB groups and swaps keymaps to reach them
+    QChar normalText = QChar(keymap.ucs(keyCode, xkbGroup, 0));
+    QChar shiftText = QChar(keymap.ucs(keyCode, xkbGroup, 1));
+
     text.append(normalText);
     text.append(shiftText);
-
-    XCloseDisplay(display);
 }
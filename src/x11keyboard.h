@@ -21,18 +21,33 @@
 #ifndef X11KEYBOARD_H
 #define X11KEYBOARD_H
 
+#include "keymapcache.h"
 #include "keysymconvert.h"
+#include "kbdlayout.h"
+#include "injectionthread.h"
 #include <fixx11h.h>
 
 #include "vkeyboard.h"
 
 #include <QObject>
-#include <QTimer>
+#include <QAbstractNativeEventFilter>
 #include <QStringList>
 #include <QChar>
+#include <QSet>
+#include <QVector>
 #include <QMap>
 
-class X11Keyboard : public VKeyboard
+class QDBusPendingCallWatcher;
+class QSocketNotifier;
+class QTimer;
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+typedef qintptr NativeEventResult;
+#else
+typedef long NativeEventResult;
+#endif
+
+class X11Keyboard : public VKeyboard, public QAbstractNativeEventFilter
 {
     Q_OBJECT
 
@@ -40,25 +55,111 @@ public:
     X11Keyboard(QObject *parent = nullptr);
     ~X11Keyboard();
     void textForKeyCode(unsigned int keyCode, ButtonText& text) override;
+    void setKeyEventDelay(unsigned long delay) override;
+    void setLatchedModifiers(const QList<unsigned int>& keyCodes) override;
+    void setStickyModifiers(bool sticky) override;
+    quint64 injectedEvents() const override;
+
+    /**
+     * Queues @p text for the injection thread, in order with the keys
+     * tapped around it. Each character is looked up in the cached keymap
+     * for the current group; characters the layout cannot produce at the
+     * first two levels are typed on spare key codes the injection thread
+     * remaps to them, least recently used first. Once every spare key has
+     * been typed, the rest of the text waits for a round trip to the server
+     * before any of them is remapped again. Latched modifiers are lifted
+     * while the text is typed.
+     */
+    int typeText(const QString& text) override;
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, NativeEventResult *result) override;
 
 public Q_SLOTS:
     void processKeyPress(unsigned int) override;
+    void processKeyDown(unsigned int) override;
+    void processKeyUp(unsigned int) override;
     void queryModState() override;
     void constructLayouts() override;
     void layoutChanged() override;
     void start() override;
+    void resendState() override;
+
+protected Q_SLOTS:
+    void readXkbEvents();
+    void rebuildKeymap();
+    void layoutIndexChanged(uint index);
+    void layoutListReceived(QDBusPendingCallWatcher *watcher);
+    void layoutIndexReceived(QDBusPendingCallWatcher *watcher);
+    void flushOverflow();
 
 protected:
-    void sendKey(unsigned int keycode);
+    void sendKey(unsigned int keycode, int type);
+    //never blocks nor drops, keySym is for Remap strokes
+    void queueStroke(unsigned int keyCode, int type, unsigned long keySym = 0, qint64 inputAt = 0);
+
+    /**
+     * Queues the release of the latched modifiers right behind the key
+     * that ends the latch, unless they are sticky, so the next key never
+     * sees them.
+     */
+    void endLatch();
 
-    QStringList layouts;
+    void selectXkbEvents();
+    void updateKeymapMasks();
+    void updateLockState(unsigned int lockedMods);
+    void updateIndicatorState(unsigned int indicators);
+    void updateGroup(int group);
+    void setGroupState(bool caps, bool num);
+    QString layoutCaption() const;
+
+    /**
+     * @return the scratch key mapped to @p keySym, or else the least
+     * recently used one not used since @p usedSince, to remap to it; -1 if
+     * there is none
+     */
+    int scratchKey(unsigned long keySym, quint64 usedSince);
+    void remapScratchKey(int index, unsigned long keySym);
+    bool isScratchKey(unsigned int keyCode) const;
+    void restoreScratchKeys();
+
+    struct ScratchKey {
+        unsigned int keyCode;
+        unsigned long keySym;
+        quint64 lastUse;
+    };
+
+    //last known reply of org.kde.KeyboardLayouts.getLayoutsList
+    QList<KbdLayout> layoutList;
     int layout_index;
+    quint64 layoutSerial;
+
+    KeymapCache keymap;
+    InjectionThread *injection;
+    //modifiers currently held down on the server
+    QList<unsigned int> latchedModifiers;
+    bool stickyModifiers;
+    //keys held down by processKeyDown
+    QSet<unsigned int> heldKeys;
+    QTimer *keymapTimer;
+    //strokes waiting for room in the injection queue, oldest first
+    QVector<KeyStroke> overflow;
+    QTimer *overflowTimer;
+    quint64 droppedStrokes;
 
     KeySymConvert kconvert;
+    QVector<ScratchKey> scratchKeys;
+    bool scratchInitialized;
+    quint64 scratchClock;
+    int xkbGroup;
 
-    bool queryModKeyState(KeySym keyCode);
     ModifierGroupStateMap groupState;
-    QTimer *groupTimer;
+
+    int xkbEventBase;
+    unsigned int capsLockMask;
+    unsigned int numLockMask;
+    int capsLockIndicator;
+    int numLockIndicator;
+    QSocketNotifier *xkbNotifier;
 };
 
 #endif // X11KEYBOARD_H